@@ -0,0 +1,109 @@
+#include "atlas.h"
+#include "utils.h"
+
+void atlas_init(atlas_t *atlas, uint32_t width, uint32_t height) {
+	error_if(width > 0xffff || height > 0xffff, "Invalid atlas size %dx%d", width, height);
+	atlas->width = width;
+	atlas->height = height;
+	atlas->used_area = 0;
+	atlas->nodes_len = 1;
+	atlas->nodes[0] = (atlas_node_t){.x = 0, .y = 0, .width = width};
+}
+
+// Returns the y position of a rect whose left edge is at the start of the
+// given node, or -1 if it doesn't fit there
+static int32_t atlas_fit(atlas_t *atlas, uint32_t index, uint32_t width, uint32_t height) {
+	if (atlas->nodes[index].x + width > atlas->width) {
+		return -1;
+	}
+
+	int32_t y = 0;
+	int32_t remaining = width;
+	for (uint32_t i = index; remaining > 0; i++) {
+		y = max(y, atlas->nodes[i].y);
+		if (y + height > atlas->height) {
+			return -1;
+		}
+		remaining -= atlas->nodes[i].width;
+	}
+	return y;
+}
+
+bool atlas_insert(atlas_t *atlas, uint32_t width, uint32_t height, vec2i_t *pos) {
+	uint32_t best_top = 0xffffffff;
+	uint32_t best_width = 0xffffffff;
+	vec2i_t best_pos = vec2i(0, 0);
+
+	for (uint32_t i = 0; i < atlas->nodes_len; i++) {
+		int32_t y = atlas_fit(atlas, i, width, height);
+		if (y < 0) {
+			continue;
+		}
+		uint32_t top = y + height;
+		if (top < best_top || (top == best_top && atlas->nodes[i].width < best_width)) {
+			best_top = top;
+			best_width = atlas->nodes[i].width;
+			best_pos = vec2i(atlas->nodes[i].x, y);
+		}
+	}
+
+	if (best_top == 0xffffffff) {
+		return false;
+	}
+	atlas_place(atlas, best_pos, width, height);
+	*pos = best_pos;
+	return true;
+}
+
+static inline void atlas_nodes_push(atlas_node_t *nodes, uint32_t *len, uint32_t x, uint32_t y, uint32_t width) {
+	if (*len > 0 && nodes[*len - 1].y == y) {
+		nodes[*len - 1].width += width;
+	}
+	else {
+		nodes[(*len)++] = (atlas_node_t){.x = x, .y = y, .width = width};
+	}
+}
+
+void atlas_place(atlas_t *atlas, vec2i_t pos, uint32_t width, uint32_t height) {
+	error_if(
+		pos.x < 0 || pos.y < 0 || pos.x + width > atlas->width || pos.y + height > atlas->height,
+		"Invalid atlas rect %d,%d %dx%d", pos.x, pos.y, width, height
+	);
+
+	// Rebuild the skyline with the span of the rect raised to its top edge.
+	// Only the first and last node in the span can be split, so there are
+	// at most two more nodes than before.
+	atlas_node_t nodes[ATLAS_NODES_MAX + 2];
+	uint32_t len = 0;
+	uint32_t x0 = pos.x;
+	uint32_t x1 = pos.x + width;
+	uint32_t top = pos.y + height;
+
+	for (uint32_t i = 0; i < atlas->nodes_len; i++) {
+		atlas_node_t *n = &atlas->nodes[i];
+		uint32_t nx0 = n->x;
+		uint32_t nx1 = n->x + n->width;
+		if (nx1 <= x0 || nx0 >= x1) {
+			atlas_nodes_push(nodes, &len, nx0, n->y, n->width);
+			continue;
+		}
+		if (nx0 < x0) {
+			atlas_nodes_push(nodes, &len, nx0, n->y, x0 - nx0);
+		}
+		uint32_t sx0 = max(nx0, x0);
+		uint32_t sx1 = min(nx1, x1);
+		atlas_nodes_push(nodes, &len, sx0, max(n->y, top), sx1 - sx0);
+		if (nx1 > x1) {
+			atlas_nodes_push(nodes, &len, x1, n->y, nx1 - x1);
+		}
+	}
+
+	error_if(len > ATLAS_NODES_MAX, "ATLAS_NODES_MAX reached");
+	memcpy(atlas->nodes, nodes, sizeof(atlas_node_t) * len);
+	atlas->nodes_len = len;
+	atlas->used_area += width * height;
+}
+
+float atlas_occupancy(atlas_t *atlas) {
+	return (float)atlas->used_area / (atlas->width * atlas->height);
+}
@@ -0,0 +1,42 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include "types.h"
+
+// Skyline rect packer for one atlas page. The skyline is the top edge of the
+// used space, stored as a list of horizontal segments from left to right. A
+// rect is always placed on top of the skyline, at the position where its top
+// edge ends up lowest; ties go to the narrowest segment, to keep wide gaps
+// free for wide rects. All space below the skyline counts as taken.
+
+#define ATLAS_NODES_MAX 256
+
+typedef struct {
+	uint16_t x;
+	uint16_t y;
+	uint16_t width;
+} atlas_node_t;
+
+typedef struct {
+	uint16_t width;
+	uint16_t height;
+	uint32_t used_area; // sum of all rects, not counting the space lost below
+	uint32_t nodes_len;
+	atlas_node_t nodes[ATLAS_NODES_MAX];
+} atlas_t;
+
+void atlas_init(atlas_t *atlas, uint32_t width, uint32_t height);
+
+// Find a position for a rect of the given size and mark it as used. Returns
+// false if the rect doesn't fit.
+bool atlas_insert(atlas_t *atlas, uint32_t width, uint32_t height, vec2i_t *pos);
+
+// Mark a rect at a known position as used. Since the skyline only depends on
+// the top edges of all rects, placing the rects of earlier atlas_insert()
+// calls again results in the same skyline, in any order.
+void atlas_place(atlas_t *atlas, vec2i_t pos, uint32_t width, uint32_t height);
+
+// The share of the page covered by rects, 0..1
+float atlas_occupancy(atlas_t *atlas);
+
+#endif
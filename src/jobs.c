@@ -0,0 +1,164 @@
+#include "jobs.h"
+#include "mem.h"
+#include "utils.h"
+
+static uint32_t threads_len = 0;
+
+static inline void jobs_call(jobs_func_t func, void *data, uint32_t index) {
+	void *scratch_mark = mem_scratch_mark();
+	func(data, index);
+	mem_scratch_reset(scratch_mark);
+}
+
+
+#if JOBS_USE_THREADS
+
+#include <pthread.h>
+#include <unistd.h>
+
+// Workers sleep on work_cond until the batch generation changes, then take
+// job indices from batch_next until all are taken. The last worker to go
+// idle, or the last job to finish, wakes the thread waiting in jobs_run().
+// A new batch is only started once all workers are idle, so that no worker
+// can take an index from a batch it didn't see start.
+
+static pthread_t threads[JOBS_THREADS_MAX];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+static jobs_func_t batch_func;
+static void *batch_data;
+static uint32_t batch_len = 0;
+static uint32_t batch_next = 0;
+static uint32_t batch_done = 0;
+static uint32_t batch_generation = 0;
+static uint32_t workers_active = 0;
+static bool wants_to_exit = false;
+
+static uint32_t jobs_work(jobs_func_t func, void *data, uint32_t len) {
+	uint32_t done = 0;
+	while (true) {
+		uint32_t index = __atomic_fetch_add(&batch_next, 1, __ATOMIC_RELAXED);
+		if (index >= len) {
+			return done;
+		}
+		jobs_call(func, data, index);
+		done++;
+	}
+}
+
+static void *jobs_thread(void *arg) {
+	uint32_t generation = 0;
+
+	pthread_mutex_lock(&lock);
+	while (true) {
+		while (generation == batch_generation && !wants_to_exit) {
+			pthread_cond_wait(&work_cond, &lock);
+		}
+		if (wants_to_exit) {
+			break;
+		}
+
+		generation = batch_generation;
+		jobs_func_t func = batch_func;
+		void *data = batch_data;
+		uint32_t len = batch_len;
+		workers_active++;
+		pthread_mutex_unlock(&lock);
+
+		uint32_t done = jobs_work(func, data, len);
+
+		pthread_mutex_lock(&lock);
+		workers_active--;
+		batch_done += done;
+		if (batch_done == batch_len || workers_active == 0) {
+			pthread_cond_signal(&done_cond);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	mem_scratch_release();
+	return NULL;
+}
+
+void jobs_init(int32_t len) {
+	if (len == JOBS_THREADS_AUTO) {
+		#if defined(_SC_NPROCESSORS_ONLN)
+			len = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+		#else
+			len = 3;
+		#endif
+	}
+	len = clamp(len, 0, JOBS_THREADS_MAX);
+
+	wants_to_exit = false;
+	for (threads_len = 0; threads_len < len; threads_len++) {
+		if (pthread_create(&threads[threads_len], NULL, jobs_thread, NULL) != 0) {
+			printf("Could not create job thread %d; continuing with %d\n", threads_len, threads_len);
+			break;
+		}
+	}
+}
+
+void jobs_cleanup() {
+	pthread_mutex_lock(&lock);
+	wants_to_exit = true;
+	pthread_cond_broadcast(&work_cond);
+	pthread_mutex_unlock(&lock);
+
+	for (int i = 0; i < threads_len; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	threads_len = 0;
+}
+
+void jobs_run(jobs_func_t func, void *data, uint32_t len) {
+	if (threads_len == 0 || len <= 1) {
+		for (uint32_t i = 0; i < len; i++) {
+			jobs_call(func, data, i);
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	while (workers_active > 0) {
+		pthread_cond_wait(&done_cond, &lock);
+	}
+	batch_func = func;
+	batch_data = data;
+	batch_len = len;
+	batch_next = 0;
+	batch_done = 0;
+	batch_generation++;
+	pthread_cond_broadcast(&work_cond);
+	pthread_mutex_unlock(&lock);
+
+	uint32_t done = jobs_work(func, data, len);
+
+	pthread_mutex_lock(&lock);
+	batch_done += done;
+	while (batch_done < len || workers_active > 0) {
+		pthread_cond_wait(&done_cond, &lock);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+#else
+
+void jobs_init(int32_t len) {
+	threads_len = 0;
+}
+
+void jobs_cleanup() {}
+
+void jobs_run(jobs_func_t func, void *data, uint32_t len) {
+	for (uint32_t i = 0; i < len; i++) {
+		jobs_call(func, data, i);
+	}
+}
+
+#endif
+
+uint32_t jobs_threads_len() {
+	return threads_len;
+}
@@ -0,0 +1,35 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "types.h"
+
+#define JOBS_THREADS_MAX 16
+#define JOBS_THREADS_AUTO -1
+
+#if !defined(JOBS_USE_THREADS)
+	#if defined(__PSP__) || defined(_arch_dreamcast) || (defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__))
+		#define JOBS_USE_THREADS 0
+	#else
+		#define JOBS_USE_THREADS 1
+	#endif
+#endif
+
+typedef void (*jobs_func_t)(void *data, uint32_t index);
+
+// Start the worker threads. JOBS_THREADS_AUTO uses one thread per cpu core
+// besides the calling thread. On platforms without threads, or with 0
+// threads, all jobs run synchronously on the calling thread.
+void jobs_init(int32_t threads_len);
+void jobs_cleanup();
+
+uint32_t jobs_threads_len();
+
+// Call func(data, index) for each index in 0..len-1 in parallel and return
+// when all of them are done. The calling thread works on jobs as well. The
+// order in which jobs run is undefined. Must not be called from within a
+// job, and only from one thread at a time.
+// Jobs must not use the hunk; they can use the scratch memory of their thread
+// instead, which is reset after each job.
+void jobs_run(jobs_func_t func, void *data, uint32_t len);
+
+#endif
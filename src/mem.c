@@ -2,15 +2,156 @@
 #include <string.h>
 
 #include "mem.h"
-#include "utils.h"
 
+#if MEM_USE_VIRTUAL && defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#elif MEM_USE_VIRTUAL
+	#include <sys/mman.h>
+	#if !defined(MAP_NORESERVE)
+		#define MAP_NORESERVE 0
+	#endif
+#endif
+
+#include "utils.h"
+#include "jobs.h"
 
-static uint8_t hunk[MEM_HUNK_BYTES];
+static uint8_t *hunk = NULL;
+static uint32_t hunk_size = 0;
 static uint32_t bump_len = 0;
 static uint32_t temp_len = 0;
 
-static uint32_t temp_objects[MEM_TEMP_OBJECTS_MAX] = {};
-static uint32_t temp_objects_len;
+static uint32_t temp_objects_len = 0;
+static uint32_t temp_frame = 0;
+
+static mem_stats_t stats = {0};
+
+static mem_tag_t tag_current = MEM_TAG_MISC;
+
+static const char *const tag_names[MEM_TAG_MAX] = {
+	[MEM_TAG_MISC] = "misc",
+	[MEM_TAG_TEXTURE] = "texture",
+	[MEM_TAG_MESH] = "mesh",
+	[MEM_TAG_TRACK] = "track",
+	[MEM_TAG_AUDIO] = "audio",
+	[MEM_TAG_VIDEO] = "video",
+};
+
+// Bump allocations are attributed to tags by keeping a list of the offsets
+// where the tag changes. Once full, the last tag gets everything that follows.
+typedef struct {
+	uint32_t start;
+	mem_tag_t tag;
+} mem_tag_run_t;
+
+static mem_tag_run_t tag_runs[MEM_TAG_RUNS_MAX];
+static uint32_t tag_runs_len = 0;
+
+// Call sites of temp allocations, referenced by index from each temp object;
+// 0 for unknown sites once full
+typedef struct {
+	const char *file;
+	int line;
+} mem_site_t;
+
+static mem_site_t sites[MEM_SITES_MAX] = {{"unknown", 0}};
+static uint32_t sites_len = 1;
+
+typedef struct {
+	const char *name;
+	uint32_t bump_high;
+	uint32_t temp_high;
+	uint32_t total_high;
+} mem_scene_t;
+
+static mem_scene_t scenes[MEM_SCENES_MAX];
+static uint32_t scenes_len = 0;
+static mem_scene_t *scene_current = NULL;
+
+
+// Backends - provide the hunk and make sure the bytes at its front and back
+// can be used
+
+// The virtual backend reserves MEM_HUNK_RESERVE_BYTES of address space once
+// and commits MEM_COMMIT_BYTES at a time from both ends as the bump and temp
+// allocators grow. The hunk stays in one place, so pointers and marks into it
+// remain valid and consecutive bumps remain contiguous. Committed pages are
+// kept when the allocators shrink again.
+
+#if MEM_USE_VIRTUAL && defined(_WIN32)
+
+static void mem_backend_init() {
+	hunk_size = MEM_HUNK_RESERVE_BYTES;
+	hunk = VirtualAlloc(NULL, hunk_size, MEM_RESERVE, PAGE_NOACCESS);
+	error_if(!hunk, "Failed to reserve %d bytes for hunk mem", hunk_size);
+}
+
+static bool mem_backend_commit(uint8_t *p, uint32_t size) {
+	return VirtualAlloc(p, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
+#elif MEM_USE_VIRTUAL
+
+static void mem_backend_init() {
+	hunk_size = MEM_HUNK_RESERVE_BYTES;
+	hunk = mmap(NULL, hunk_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	error_if(hunk == MAP_FAILED, "Failed to reserve %d bytes for hunk mem", hunk_size);
+}
+
+static bool mem_backend_commit(uint8_t *p, uint32_t size) {
+	return mprotect(p, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+#else
+
+static uint8_t static_hunk[MEM_HUNK_BYTES] __attribute__((aligned(MEM_TEMP_ALIGN)));
+
+static void mem_backend_init() {
+	hunk = static_hunk;
+	hunk_size = MEM_HUNK_BYTES;
+	stats.committed = MEM_HUNK_BYTES;
+}
+
+static bool mem_backend_commit(uint8_t *p, uint32_t size) {
+	return true;
+}
+
+#endif
+
+static inline void mem_init_if_needed() {
+	if (!hunk) {
+		mem_backend_init();
+		stats.capacity = hunk_size;
+	}
+}
+
+// Commit everything up to bump_len at the front and temp_len at the back
+static void mem_commit() {
+	static uint32_t front_committed = 0;
+	static uint32_t back_committed = 0;
+
+	if (bump_len > front_committed) {
+		uint32_t end = min(hunk_size, ((bump_len + MEM_COMMIT_BYTES - 1) / MEM_COMMIT_BYTES) * MEM_COMMIT_BYTES);
+		error_if(!mem_backend_commit(hunk + front_committed, end - front_committed), "Failed to commit %d bytes in hunk mem", end - front_committed);
+		front_committed = end;
+	}
+	if (temp_len > back_committed) {
+		uint32_t end = min(hunk_size, ((temp_len + MEM_COMMIT_BYTES - 1) / MEM_COMMIT_BYTES) * MEM_COMMIT_BYTES);
+		error_if(!mem_backend_commit(hunk + hunk_size - end, end - back_committed), "Failed to commit %d bytes in temp mem", end - back_committed);
+		back_committed = end;
+	}
+
+	#if MEM_USE_VIRTUAL
+		stats.committed = min(hunk_size, front_committed + back_committed);
+	#endif
+}
+
+static inline void mem_update_high_water() {
+	stats.bump_high = max(stats.bump_high, bump_len);
+	stats.temp_high = max(stats.temp_high, temp_len);
+	stats.total_high = max(stats.total_high, bump_len + temp_len);
+}
 
 
 // Bump allocator - returns bytes from the front of the hunk
@@ -19,21 +160,34 @@ static uint32_t temp_objects_len;
 // whenever we load a new race track or menu in game_set_scene()
 
 void *mem_mark() {
+	mem_init_if_needed();
 	return &hunk[bump_len];
 }
 
 void *mem_bump(uint32_t size) {
-	error_if(bump_len + temp_len + size >= MEM_HUNK_BYTES, "Failed to allocate %d bytes in hunk mem", size);
+	mem_init_if_needed();
+	error_if(bump_len + temp_len + size >= hunk_size, "Failed to allocate %d bytes in hunk mem", size);
 	uint8_t *p = &hunk[bump_len];
+	if (
+		tag_runs_len < MEM_TAG_RUNS_MAX &&
+		(tag_runs_len == 0 || tag_runs[tag_runs_len - 1].tag != tag_current)
+	) {
+		tag_runs[tag_runs_len++] = (mem_tag_run_t){.start = bump_len, .tag = tag_current};
+	}
 	bump_len += size;
+	mem_commit();
+	mem_update_high_water();
 	memset(p, 0, size);
 	return p;
 }
 
 void mem_reset(void *p) {
 	uint32_t offset = (uint8_t *)p - (uint8_t *)hunk;
-	error_if(offset > bump_len || offset > MEM_HUNK_BYTES, "Invalid mem reset");
+	error_if(offset > bump_len || offset > hunk_size, "Invalid mem reset");
 	bump_len = offset;
+	while (tag_runs_len > 0 && tag_runs[tag_runs_len - 1].start >= offset) {
+		tag_runs_len--;
+	}
 }
 
 
@@ -45,37 +199,365 @@ void mem_reset(void *p) {
 // have be freed in reverse allocation order. I.e. you can allocate A then B, 
 // and aftewards free A then B.
 
-void *mem_temp_alloc(uint32_t size) {
-	size = ((size >> 3) + 7) << 3; // allign to 8 bytes
+// Temp objects are stacked downwards from the end of the hunk, each one
+// preceded by a header that holds its own size and that of the block directly
+// below it. Freeing merges a block with both of its neighbors in constant time.
+// A free block at the bottom of the stack is given back to the hunk; all other
+// free blocks are kept in a list and reused by later allocations.
 
-	error_if(bump_len + temp_len + size >= MEM_HUNK_BYTES, "Failed to allocate %d bytes in temp mem", size);
-	error_if(temp_objects_len >= MEM_TEMP_OBJECTS_MAX, "MEM_TEMP_OBJECTS_MAX reached");
+typedef struct mem_temp_block_t {
+	uint32_t size; // incl. the header
+	uint32_t lower_size; // of the block below; 0 for the lowest block
+	uint16_t frame;
+	uint8_t is_free;
+	uint8_t tag;
+	uint16_t site;
+	uint16_t unused;
 
-	temp_len += size;
-	void *p = &hunk[MEM_HUNK_BYTES - temp_len];
-	temp_objects[temp_objects_len++] = temp_len;
-	return p;
+	// Only valid in free blocks; overlaps the object otherwise
+	struct mem_temp_block_t *free_prev;
+	struct mem_temp_block_t *free_next;
+} mem_temp_block_t;
+
+#define MEM_TEMP_HEADER_BYTES 16
+#define MEM_TEMP_BLOCK_MIN ((sizeof(mem_temp_block_t) + MEM_TEMP_ALIGN - 1) & ~(MEM_TEMP_ALIGN - 1))
+
+static mem_temp_block_t *temp_free_list = NULL;
+
+static inline mem_temp_block_t *mem_temp_lowest() {
+	return (mem_temp_block_t *)&hunk[hunk_size - temp_len];
+}
+
+static inline mem_temp_block_t *mem_temp_above(mem_temp_block_t *b) {
+	uint8_t *p = (uint8_t *)b + b->size;
+	return p < hunk + hunk_size ? (mem_temp_block_t *)p : NULL;
+}
+
+static inline mem_temp_block_t *mem_temp_below(mem_temp_block_t *b) {
+	return b->lower_size ? (mem_temp_block_t *)((uint8_t *)b - b->lower_size) : NULL;
+}
+
+static void mem_temp_list_add(mem_temp_block_t *b) {
+	b->free_prev = NULL;
+	b->free_next = temp_free_list;
+	if (temp_free_list) {
+		temp_free_list->free_prev = b;
+	}
+	temp_free_list = b;
+}
+
+static void mem_temp_list_remove(mem_temp_block_t *b) {
+	if (b->free_prev) {
+		b->free_prev->free_next = b->free_next;
+	}
+	else {
+		temp_free_list = b->free_next;
+	}
+	if (b->free_next) {
+		b->free_next->free_prev = b->free_prev;
+	}
+}
+
+static uint16_t mem_site(const char *file, int line) {
+	for (uint32_t i = 1; i < sites_len; i++) {
+		if (sites[i].line == line && sites[i].file == file) {
+			return i;
+		}
+	}
+	if (sites_len >= MEM_SITES_MAX) {
+		return 0;
+	}
+	sites[sites_len] = (mem_site_t){.file = file, .line = line};
+	return sites_len++;
+}
+
+void *mem_temp_alloc_at(uint32_t size, const char *file, int line) {
+	mem_init_if_needed();
+	size = max((size + MEM_TEMP_HEADER_BYTES + MEM_TEMP_ALIGN - 1) & ~(MEM_TEMP_ALIGN - 1), MEM_TEMP_BLOCK_MIN);
+
+	mem_temp_block_t *b = temp_free_list;
+	while (b && b->size < size) {
+		b = b->free_next;
+	}
+
+	if (b) {
+		// Reuse a free block; split off the part above if it's large enough
+		mem_temp_list_remove(b);
+		if (b->size - size >= MEM_TEMP_BLOCK_MIN) {
+			mem_temp_block_t *rest = (mem_temp_block_t *)((uint8_t *)b + size);
+			rest->size = b->size - size;
+			rest->lower_size = size;
+			rest->is_free = true;
+			mem_temp_block_t *above = mem_temp_above(rest);
+			if (above) {
+				above->lower_size = rest->size;
+			}
+			mem_temp_list_add(rest);
+			b->size = size;
+		}
+	}
+	else {
+		error_if(bump_len + temp_len + size >= hunk_size, "Failed to allocate %d bytes in temp mem", size);
+		mem_temp_block_t *lowest = temp_len ? mem_temp_lowest() : NULL;
+		temp_len += size;
+		mem_commit();
+		b = mem_temp_lowest();
+		b->size = size;
+		b->lower_size = 0;
+		if (lowest) {
+			lowest->lower_size = size;
+		}
+	}
+
+	b->is_free = false;
+	b->frame = temp_frame;
+	b->tag = tag_current;
+	b->site = mem_site(file, line);
+	temp_objects_len++;
+	mem_update_high_water();
+	return (uint8_t *)b + MEM_TEMP_HEADER_BYTES;
 }
 
 void mem_temp_free(void *p) {
-	uint32_t offset = (uint8_t *)&hunk[MEM_HUNK_BYTES] - (uint8_t *)p;
-	error_if(offset > MEM_HUNK_BYTES, "Object 0x%p not in temp hunk", p);
-
-	bool found = false;
-	uint32_t remaining_max = 0;
-	for (int i = 0; i < temp_objects_len; i++) {
-		if (temp_objects[i] == offset) {
-			temp_objects[i--] = temp_objects[--temp_objects_len];
-			found = true;
+	mem_temp_block_t *b = (mem_temp_block_t *)((uint8_t *)p - MEM_TEMP_HEADER_BYTES);
+	error_if(
+		(uint8_t *)b < (uint8_t *)mem_temp_lowest() || (uint8_t *)b >= hunk + hunk_size || b->is_free,
+		"Object 0x%p not in temp hunk", p
+	);
+	temp_objects_len--;
+
+	b->is_free = true;
+	mem_temp_block_t *above = mem_temp_above(b);
+	if (above && above->is_free) {
+		mem_temp_list_remove(above);
+		b->size += above->size;
+	}
+	mem_temp_block_t *below = mem_temp_below(b);
+	if (below && below->is_free) {
+		mem_temp_list_remove(below);
+		below->size += b->size;
+		b = below;
+	}
+
+	above = mem_temp_above(b);
+	if (b == mem_temp_lowest()) {
+		temp_len -= b->size;
+		if (above) {
+			above->lower_size = 0;
 		}
-		else if (temp_objects[i] > remaining_max) {
-			remaining_max = temp_objects[i];
+	}
+	else {
+		if (above) {
+			above->lower_size = b->size;
 		}
+		mem_temp_list_add(b);
 	}
-	error_if(!found, "Object 0x%p not in temp hunk", p);
-	temp_len = remaining_max;
 }
 
 void mem_temp_check() {
-	error_if(temp_len != 0, "Temp memory not free: %d object(s)", temp_objects_len);
+	if (temp_len == 0) {
+		return;
+	}
+	for (mem_temp_block_t *b = mem_temp_lowest(); b; b = mem_temp_above(b)) {
+		if (!b->is_free) {
+			mem_site_t *site = &sites[b->site];
+			printf(
+				"Temp object not freed: %d bytes, %s, allocated at %s line %d\n",
+				b->size - MEM_TEMP_HEADER_BYTES, tag_names[b->tag], site->file, site->line
+			);
+		}
+	}
+	die("Temp memory not free: %d object(s)", temp_objects_len);
+}
+
+uint32_t mem_temp_frame_begin() {
+	return ++temp_frame;
+}
+
+void mem_temp_frame_end(uint32_t frame) {
+	error_if(frame != temp_frame, "Temp frame %d ended out of order", frame);
+	temp_frame--;
+	if (temp_len == 0) {
+		return;
+	}
+
+	// Free all objects of this frame and merge all runs of free blocks in one
+	// pass from the bottom up; the free list is rebuilt on the way.
+	temp_free_list = NULL;
+	mem_temp_block_t *run = NULL;
+	for (mem_temp_block_t *b = mem_temp_lowest(), *next; b; b = next) {
+		next = mem_temp_above(b);
+		if (!b->is_free && b->frame >= frame) {
+			b->is_free = true;
+			temp_objects_len--;
+		}
+
+		if (b->is_free) {
+			if (run) {
+				run->size += b->size;
+			}
+			else {
+				run = b;
+			}
+		}
+		else if (run) {
+			b->lower_size = run->size;
+			mem_temp_list_add(run);
+			run = NULL;
+		}
+	}
+	if (run) {
+		mem_temp_list_add(run);
+	}
+
+	mem_temp_block_t *lowest = mem_temp_lowest();
+	if (lowest->is_free) {
+		mem_temp_list_remove(lowest);
+		temp_len -= lowest->size;
+		if (temp_len) {
+			mem_temp_lowest()->lower_size = 0;
+		}
+	}
+}
+
+
+
+// Scratch memory - a linear arena for each thread
+
+// With threads, each arena is malloc'd on the first use in its thread. The
+// bytes are only touched when they are used, so on platforms with virtual
+// memory most of it is never committed.
+
+#if JOBS_USE_THREADS
+	#define MEM_THREAD_LOCAL __thread
+#else
+	#define MEM_THREAD_LOCAL
+#endif
+
+static MEM_THREAD_LOCAL uint8_t *scratch = NULL;
+static MEM_THREAD_LOCAL uint32_t scratch_len = 0;
+
+static inline void mem_scratch_init_if_needed() {
+	if (!scratch) {
+		scratch = malloc(MEM_SCRATCH_BYTES);
+		error_if(!scratch, "Failed to allocate %d bytes for scratch mem", MEM_SCRATCH_BYTES);
+	}
+}
+
+void *mem_scratch_alloc(uint32_t size) {
+	mem_scratch_init_if_needed();
+	size = (size + MEM_TEMP_ALIGN - 1) & ~(MEM_TEMP_ALIGN - 1);
+	error_if(scratch_len + size > MEM_SCRATCH_BYTES, "Failed to allocate %d bytes in scratch mem", size);
+
+	uint8_t *p = scratch + scratch_len;
+	scratch_len += size;
+	return p;
+}
+
+void *mem_scratch_mark() {
+	mem_scratch_init_if_needed();
+	return scratch + scratch_len;
+}
+
+void mem_scratch_reset(void *p) {
+	uint32_t offset = (uint8_t *)p - scratch;
+	error_if(offset > scratch_len, "Invalid scratch mem reset");
+	scratch_len = offset;
+}
+
+void mem_scratch_release() {
+	error_if(scratch_len != 0, "Scratch memory not free: %d bytes", scratch_len);
+	free(scratch);
+	scratch = NULL;
+}
+
+
+
+// Stats
+
+mem_stats_t mem_get_stats() {
+	mem_init_if_needed();
+	stats.bump_len = bump_len;
+	stats.temp_len = temp_len;
+	return stats;
+}
+
+void mem_reset_high_water() {
+	stats.bump_high = bump_len;
+	stats.temp_high = temp_len;
+	stats.total_high = bump_len + temp_len;
+}
+
+mem_tag_t mem_set_tag(mem_tag_t tag) {
+	mem_tag_t previous = tag_current;
+	tag_current = tag;
+	return previous;
+}
+
+static void mem_scene_update() {
+	if (scene_current) {
+		scene_current->bump_high = max(scene_current->bump_high, stats.bump_high);
+		scene_current->temp_high = max(scene_current->temp_high, stats.temp_high);
+		scene_current->total_high = max(scene_current->total_high, stats.total_high);
+	}
+}
+
+void mem_set_scene(const char *name) {
+	mem_scene_update();
+	scene_current = NULL;
+	for (int i = 0; i < scenes_len; i++) {
+		if (scenes[i].name == name) {
+			scene_current = &scenes[i];
+		}
+	}
+	if (!scene_current && scenes_len < MEM_SCENES_MAX) {
+		scene_current = &scenes[scenes_len++];
+		*scene_current = (mem_scene_t){.name = name};
+	}
+	mem_reset_high_water();
+}
+
+void mem_report() {
+	mem_init_if_needed();
+	mem_scene_update();
+
+	uint32_t bump_tags[MEM_TAG_MAX] = {0};
+	for (int i = 0; i < tag_runs_len; i++) {
+		uint32_t end = i + 1 < tag_runs_len ? tag_runs[i + 1].start : bump_len;
+		bump_tags[tag_runs[i].tag] += end - tag_runs[i].start;
+	}
+
+	uint32_t temp_tags[MEM_TAG_MAX] = {0};
+	uint32_t holes_len = 0;
+	uint32_t holes_bytes = 0;
+	uint32_t hole_max = 0;
+	if (temp_len) {
+		for (mem_temp_block_t *b = mem_temp_lowest(); b; b = mem_temp_above(b)) {
+			if (b->is_free) {
+				holes_len++;
+				holes_bytes += b->size;
+				hole_max = max(hole_max, b->size);
+			}
+			else {
+				temp_tags[b->tag] += b->size;
+			}
+		}
+	}
+
+	printf("mem: %d kb used of %d kb, %d kb committed\n", (bump_len + temp_len) / 1024, hunk_size / 1024, stats.committed / 1024);
+	printf("  %-10s %10s %10s\n", "tag", "bump kb", "temp kb");
+	for (int i = 0; i < MEM_TAG_MAX; i++) {
+		printf("  %-10s %10.1f %10.1f\n", tag_names[i], bump_tags[i] / 1024.0, temp_tags[i] / 1024.0);
+	}
+	printf(
+		"  temp: %d object(s), %d hole(s) of %.1f kb (%.1f%%), largest %.1f kb\n",
+		temp_objects_len, holes_len, holes_bytes / 1024.0,
+		temp_len ? holes_bytes * 100.0 / temp_len : 0.0, hole_max / 1024.0
+	);
+	for (int i = 0; i < scenes_len; i++) {
+		printf(
+			"  scene %-10s high-water %8.1f kb (bump %8.1f kb, temp %8.1f kb)\n",
+			scenes[i].name, scenes[i].total_high / 1024.0, scenes[i].bump_high / 1024.0, scenes[i].temp_high / 1024.0
+		);
+	}
 }
@@ -3,15 +3,91 @@
 
 #include "types.h"
 
-#define MEM_TEMP_OBJECTS_MAX 8
+// Platforms with virtual memory reserve a large address range for the hunk
+// and commit pages as it grows. All others use a static hunk of
+// MEM_HUNK_BYTES.
+#if !defined(MEM_USE_VIRTUAL)
+	#if defined(__PSP__) || defined(_arch_dreamcast) || defined(__EMSCRIPTEN__)
+		#define MEM_USE_VIRTUAL 0
+	#elif defined(_WIN32) || defined(__unix__) || defined(__APPLE__)
+		#define MEM_USE_VIRTUAL 1
+	#else
+		#define MEM_USE_VIRTUAL 0
+	#endif
+#endif
+
 #define MEM_HUNK_BYTES (4 * 1024 * 1024)
+#define MEM_HUNK_RESERVE_BYTES (UINTPTR_MAX > 0xffffffff ? (1024 * 1024 * 1024) : (256 * 1024 * 1024))
+#define MEM_COMMIT_BYTES (1024 * 1024)
+#define MEM_TEMP_ALIGN 16
+
+#if !defined(MEM_SCRATCH_BYTES)
+	#define MEM_SCRATCH_BYTES (MEM_USE_VIRTUAL ? (4 * 1024 * 1024) : (256 * 1024))
+#endif
+
+#define MEM_TAG_RUNS_MAX 1024
+#define MEM_SITES_MAX 256
+#define MEM_SCENES_MAX 8
+
+// All allocations are attributed to the current tag
+typedef enum {
+	MEM_TAG_MISC,
+	MEM_TAG_TEXTURE,
+	MEM_TAG_MESH,
+	MEM_TAG_TRACK,
+	MEM_TAG_AUDIO,
+	MEM_TAG_VIDEO,
+	MEM_TAG_MAX
+} mem_tag_t;
+
+typedef struct {
+	uint32_t bump_len;
+	uint32_t temp_len;
+	uint32_t bump_high; // high-water marks since mem_reset_high_water()
+	uint32_t temp_high;
+	uint32_t total_high;
+	uint32_t committed;
+	uint32_t capacity;
+} mem_stats_t;
 
 void *mem_bump(uint32_t size);
 void *mem_mark();
 void mem_reset(void *p);
 
-void *mem_temp_alloc(uint32_t size);
+// Temp objects remember where they were allocated, so that mem_temp_check()
+// can tell which ones were not freed.
+#define mem_temp_alloc(SIZE) mem_temp_alloc_at(SIZE, __FILE__, __LINE__)
+void *mem_temp_alloc_at(uint32_t size, const char *file, int line);
 void mem_temp_free(void *p);
 void mem_temp_check();
 
+// Temp frames free all temp objects that were allocated after
+// mem_temp_frame_begin() and not freed yet, in mem_temp_frame_end(). Frames
+// can be nested, but have to be ended in reverse order.
+uint32_t mem_temp_frame_begin();
+void mem_temp_frame_end(uint32_t frame);
+
+// Scratch memory - a linear arena for each thread that never touches the
+// hunk. Allocations are freed by resetting to an earlier mark. The jobs system
+// does this after each job, so jobs can allocate without freeing.
+void *mem_scratch_alloc(uint32_t size);
+void *mem_scratch_mark();
+void mem_scratch_reset(void *p);
+void mem_scratch_release(); // free the arena of the calling thread
+
+mem_stats_t mem_get_stats();
+void mem_reset_high_water();
+
+// Set the tag for all following allocations and return the previous one, so
+// that it can be restored.
+mem_tag_t mem_set_tag(mem_tag_t tag);
+
+// Attribute the high-water marks from here on to the scene with this name,
+// until the next call. The name is not copied.
+void mem_set_scene(const char *name);
+
+// Print the current usage per tag, the fragmentation of temp memory and the
+// high-water marks of each scene so far.
+void mem_report();
+
 #endif
@@ -0,0 +1,112 @@
+#include <string.h>
+
+#include "pak.h"
+#include "utils.h"
+
+typedef struct {
+	char path[PAK_PATH_LEN];
+	uint8_t *bytes;
+	uint32_t size;
+} pak_mount_t;
+
+static pak_mount_t mounts[PAK_MOUNTS_MAX];
+static uint32_t mounts_len = 0;
+
+// Archives can outlive a scene, so without mmap they are read into memory of
+// their own instead of the hunk, and freed again by pak_unmount().
+static uint8_t *pak_read(char *path, uint32_t *size) {
+#if FILE_USE_MMAP
+	return file_map(path, size);
+#else
+	FILE *f = fopen(path, "rb");
+	error_if(!f, "Could not open file for reading: %s", path);
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *bytes = malloc(*size);
+	error_if(!bytes, "Failed to allocate %d bytes for %s", *size, path);
+	error_if(fread(bytes, 1, *size, f) != *size, "Could not read file: %s", path);
+	fclose(f);
+	return bytes;
+#endif
+}
+
+bool pak_mount(char *path) {
+	for (int i = 0; i < mounts_len; i++) {
+		if (strncmp(mounts[i].path, path, PAK_PATH_LEN) == 0) {
+			return true;
+		}
+	}
+	if (!file_exists(path)) {
+		return false;
+	}
+	error_if(mounts_len >= PAK_MOUNTS_MAX, "PAK_MOUNTS_MAX reached");
+	error_if(strlen(path) >= PAK_PATH_LEN, "Pak path %s too long", path);
+
+	uint32_t size = 0;
+	uint8_t *bytes = pak_read(path, &size);
+	pak_header_t *header = (pak_header_t *)bytes;
+	error_if(!bytes || size < sizeof(pak_header_t), "Pak %s is truncated", path);
+	error_if(
+		header->magic != PAK_MAGIC || header->version != PAK_VERSION,
+		"Pak %s has the wrong version or byte order; rebuild it with wipeout-pack", path
+	);
+	error_if(sizeof(pak_header_t) + header->entries_len * sizeof(pak_entry_t) > size, "Pak %s is truncated", path);
+	for (int i = 0; i < header->entries_len; i++) {
+		pak_entry_t *e = &header->entries[i];
+		error_if(e->offset > size || e->size > size - e->offset, "Pak %s is truncated", path);
+	}
+
+	pak_mount_t *m = &mounts[mounts_len++];
+	strcpy(m->path, path);
+	m->bytes = bytes;
+	m->size = size;
+	printf("mounted %s with %d files\n", path, header->entries_len);
+	return true;
+}
+
+bool pak_unmount(char *path) {
+	for (int i = 0; i < mounts_len; i++) {
+		if (strncmp(mounts[i].path, path, PAK_PATH_LEN) != 0) {
+			continue;
+		}
+
+		// Remove the mount before releasing it, so that file_unmap() doesn't
+		// take the archive for one of its files
+		pak_mount_t m = mounts[i];
+		memmove(&mounts[i], &mounts[i + 1], sizeof(pak_mount_t) * (mounts_len - i - 1));
+		mounts_len--;
+#if FILE_USE_MMAP
+		file_unmap(m.bytes, m.size);
+#else
+		free(m.bytes);
+#endif
+		printf("unmounted %s\n", path);
+		return true;
+	}
+	return false;
+}
+
+uint8_t *pak_find(char *path, uint32_t *size, pak_entry_type_t *type) {
+	for (int m = mounts_len - 1; m >= 0; m--) {
+		pak_header_t *header = (pak_header_t *)mounts[m].bytes;
+		for (int i = 0; i < header->entries_len; i++) {
+			pak_entry_t *e = &header->entries[i];
+			if (strncmp(e->path, path, PAK_PATH_LEN) == 0) {
+				*size = e->size;
+				*type = e->type;
+				return mounts[m].bytes + e->offset;
+			}
+		}
+	}
+	return NULL;
+}
+
+bool pak_contains(void *p) {
+	for (int m = 0; m < mounts_len; m++) {
+		if ((uint8_t *)p >= mounts[m].bytes && (uint8_t *)p < mounts[m].bytes + mounts[m].size) {
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,56 @@
+#ifndef PAK_H
+#define PAK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Archives of game files, built offline with wipeout-pack (src/tools/pack.c).
+// While an archive is mounted, file_map() returns the files in it straight
+// from the mapped archive, and .cmp files are stored already decompressed.
+// The header, table of contents and data are aligned to PAK_ALIGN and stored
+// in the byte order of the machine that built the archive; the contents of
+// the files themselves are unchanged.
+
+#define PAK_MAGIC 0x4b415057 // "WPAK"
+#define PAK_VERSION 1
+#define PAK_PATH_LEN 64
+#define PAK_ALIGN 16
+#define PAK_MOUNTS_MAX 16
+
+typedef enum {
+	PAK_ENTRY_RAW,
+	PAK_ENTRY_CMP_DECOMPRESSED, // the .cmp header, followed by all images
+} pak_entry_type_t;
+
+typedef struct {
+	char path[PAK_PATH_LEN];
+	uint32_t offset; // from the start of the archive
+	uint32_t size;
+	uint32_t type;
+	uint32_t unused;
+} pak_entry_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entries_len;
+	uint32_t unused;
+	pak_entry_t entries[];
+} pak_header_t;
+
+// Mount the archive at path, if it exists. Mounting the same path again does
+// nothing. Files in later archives take precedence.
+bool pak_mount(char *path);
+
+// Unmount the archive at path and release its memory. Pointers returned by
+// pak_find() or file_map() for files in it become invalid. Returns false if
+// it wasn't mounted.
+bool pak_unmount(char *path);
+
+// The bytes of the file at path in any mounted archive, or NULL
+uint8_t *pak_find(char *path, uint32_t *size, pak_entry_type_t *type);
+
+// Whether p points into a mounted archive
+bool pak_contains(void *p);
+
+#endif
@@ -0,0 +1,341 @@
+#include <string.h>
+#include <time.h>
+
+#include "platform.h"
+#include "system.h"
+#include "utils.h"
+#include "profiler.h"
+#include "render.h"
+#include "mem.h"
+
+#include "wipeout/game.h"
+#include "wipeout/race.h"
+
+// A headless platform without window, input or audio output. Instead of the
+// usual main loop it runs a number of attract mode races on a fixed tick and
+// reports the frame time distribution for each of them.
+
+#define BENCH_SCREEN_WIDTH 1280
+#define BENCH_SCREEN_HEIGHT 720
+#define BENCH_AUDIO_SAMPLERATE 44100
+#define BENCH_ATTRACT_DURATION_MAX 30.0
+
+static bool wants_to_exit = false;
+static void (*audio_callback)(float *buffer, uint32_t len) = NULL;
+
+
+void platform_exit() {
+	wants_to_exit = true;
+}
+
+vec2i_t platform_screen_size() {
+	return vec2i(BENCH_SCREEN_WIDTH, BENCH_SCREEN_HEIGHT);
+}
+
+scalar_t platform_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (scalar_t)ts.tv_sec + (scalar_t)ts.tv_nsec / 1000000000.0;
+}
+
+void platform_set_fullscreen(bool fullscreen) {}
+
+void platform_set_audio_mix_cb(void (*cb)(float *buffer, uint32_t len)) {
+	audio_callback = cb;
+}
+
+#if defined(RENDERER_SOFTWARE)
+	static rgba_t screenbuffer[BENCH_SCREEN_WIDTH * BENCH_SCREEN_HEIGHT];
+
+	rgba_t *platform_get_screenbuffer(int32_t *pitch) {
+		*pitch = BENCH_SCREEN_WIDTH * sizeof(rgba_t);
+		return screenbuffer;
+	}
+#endif
+
+
+
+// -----------------------------------------------------------------------------
+// Benchmark
+
+typedef struct {
+	int races;
+	int frames;
+	scalar_t tick;
+	int circut;
+	int race_class;
+	int seed;
+	char *profile_csv;
+	char *profile_trace;
+} bench_settings_t;
+
+typedef struct {
+	double flushes;
+	double draw_calls;
+	double tris;
+	double bytes_uploaded;
+	double texture_binds;
+	double state_changes;
+	double hiz_hits;
+	double hiz_misses;
+	uint32_t textures_len;
+	float atlas_occupancy;
+	uint32_t atlas_pages;
+	uint32_t frames;
+} bench_stats_t;
+
+static int bench_compare_time(const void *a, const void *b) {
+	scalar_t ta = *(const scalar_t *)a;
+	scalar_t tb = *(const scalar_t *)b;
+	return (ta > tb) - (ta < tb);
+}
+
+static scalar_t bench_percentile(scalar_t *sorted, int len, scalar_t p) {
+	return sorted[(int)(p * (len - 1) + 0.5)];
+}
+
+static void bench_stats_add(bench_stats_t *sum, render_stats_t s) {
+	sum->flushes += s.flushes;
+	sum->draw_calls += s.draw_calls;
+	sum->tris += s.tris;
+	sum->bytes_uploaded += s.bytes_uploaded;
+	sum->texture_binds += s.texture_binds;
+	sum->state_changes += s.state_changes;
+	sum->hiz_hits += s.hiz_hits;
+	sum->hiz_misses += s.hiz_misses;
+	sum->textures_len = max(sum->textures_len, s.textures_len);
+	sum->atlas_occupancy = max(sum->atlas_occupancy, s.atlas_occupancy);
+	sum->atlas_pages = max(sum->atlas_pages, s.atlas_pages);
+	sum->frames++;
+}
+
+static void bench_stats_merge(bench_stats_t *sum, bench_stats_t *s) {
+	sum->flushes += s->flushes;
+	sum->draw_calls += s->draw_calls;
+	sum->tris += s->tris;
+	sum->bytes_uploaded += s->bytes_uploaded;
+	sum->texture_binds += s->texture_binds;
+	sum->state_changes += s->state_changes;
+	sum->hiz_hits += s->hiz_hits;
+	sum->hiz_misses += s->hiz_misses;
+	sum->textures_len = max(sum->textures_len, s->textures_len);
+	sum->atlas_occupancy = max(sum->atlas_occupancy, s->atlas_occupancy);
+	sum->atlas_pages = max(sum->atlas_pages, s->atlas_pages);
+	sum->frames += s->frames;
+}
+
+static void bench_print_stats(const char *name, bench_stats_t *sum) {
+	// Counters are averages per frame; textures, atlas occupancy and pages
+	// are the maximum seen. hiz is the share of blocks rejected by depth early.
+	double len = max(sum->frames, 1);
+	double hiz_tests = max(sum->hiz_hits + sum->hiz_misses, 1);
+	printf(
+		"%-24s %7.1f %7.1f %7.0f %7.1f %7.1f %9.1f %7d %6.1f%% %7d %6.1f%%\n",
+		name, sum->flushes / len, sum->draw_calls / len, sum->tris / len,
+		sum->texture_binds / len, sum->state_changes / len,
+		(sum->bytes_uploaded / len) / 1024.0, sum->textures_len,
+		sum->atlas_occupancy * 100.0, sum->atlas_pages, (sum->hiz_hits / hiz_tests) * 100.0
+	);
+}
+
+static void bench_print_times(const char *name, scalar_t *times, int len, scalar_t load_time, scalar_t audio_time) {
+	qsort(times, len, sizeof(scalar_t), bench_compare_time);
+
+	scalar_t sum = 0;
+	for (int i = 0; i < len; i++) {
+		sum += times[i];
+	}
+
+	printf(
+		"%-24s %7.2f %7.3f %7.3f %7.3f %7.3f %7.3f %7.3f %7.3f\n",
+		name, load_time * 1000.0, (sum / len) * 1000.0,
+		bench_percentile(times, len, 0.50) * 1000.0,
+		bench_percentile(times, len, 0.90) * 1000.0,
+		bench_percentile(times, len, 0.95) * 1000.0,
+		bench_percentile(times, len, 0.99) * 1000.0,
+		times[len-1] * 1000.0,
+		(audio_time / len) * 1000.0
+	);
+}
+
+static void bench_usage(const char *name) {
+	printf(
+		"usage: %s [options]\n"
+		"  --races N     number of races to run (default 6)\n"
+		"  --frames N    frames to run per race (default 1200)\n"
+		"  --tick S      fixed game tick in seconds (default 1/60)\n"
+		"  --circut N    only run this circut (default: cycle through all)\n"
+		"  --class N     race class; 0 = venom, 1 = rapier (default 0)\n"
+		"  --seed N      random seed (default 1)\n"
+		"  --profile-csv FILE    enable the profiler and write the history of the last frames\n"
+		"  --profile-trace FILE  same, as chrome trace json\n",
+		name
+	);
+}
+
+static bench_settings_t bench_parse_args(int argc, char *argv[]) {
+	bench_settings_t settings = {
+		.races = NUM_NON_BONUS_CIRCUTS,
+		.frames = 1200,
+		.tick = 1.0 / 60.0,
+		.circut = -1,
+		.race_class = RACE_CLASS_VENOM,
+		.seed = 1
+	};
+
+	for (int i = 1; i < argc; i++) {
+		bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "--races") == 0 && has_value) {
+			settings.races = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--frames") == 0 && has_value) {
+			settings.frames = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--tick") == 0 && has_value) {
+			settings.tick = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--circut") == 0 && has_value) {
+			settings.circut = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--class") == 0 && has_value) {
+			settings.race_class = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--seed") == 0 && has_value) {
+			settings.seed = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--profile-csv") == 0 && has_value) {
+			settings.profile_csv = argv[++i];
+		}
+		else if (strcmp(argv[i], "--profile-trace") == 0 && has_value) {
+			settings.profile_trace = argv[++i];
+		}
+		else {
+			bench_usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	error_if(settings.races < 1, "Need at least one race");
+	error_if(settings.frames < 1, "Need at least one frame per race");
+	error_if(settings.tick <= 0, "Invalid tick %f", settings.tick);
+	error_if(settings.circut >= NUM_CIRCUTS, "Invalid circut %d", settings.circut);
+	error_if(settings.race_class < 0 || settings.race_class >= NUM_RACE_CLASSES, "Invalid class %d", settings.race_class);
+
+	// Attract mode races are cut short and go back to the title screen after
+	// 30 seconds; don't run into that.
+	error_if(
+		settings.frames * settings.tick > BENCH_ATTRACT_DURATION_MAX,
+		"Race length of %.1fs exceeds the attract mode duration", settings.frames * settings.tick
+	);
+	return settings;
+}
+
+int main(int argc, char *argv[]) {
+	bench_settings_t settings = bench_parse_args(argc, argv);
+
+	uint32_t audio_len = (uint32_t)(BENCH_AUDIO_SAMPLERATE * settings.tick) * 2;
+	float *audio_buffer = malloc(audio_len * sizeof(float));
+	scalar_t *frame_times = malloc(settings.frames * sizeof(scalar_t));
+	scalar_t *all_frame_times = malloc(settings.frames * settings.races * sizeof(scalar_t));
+	bench_stats_t *race_stats = malloc(settings.races * sizeof(bench_stats_t));
+	bench_stats_t all_stats = {0};
+	scalar_t all_load_time = 0;
+	scalar_t all_audio_time = 0;
+	int races_run = 0;
+
+	system_fixed_tick_set(settings.tick);
+	system_init();
+
+	if (settings.profile_csv || settings.profile_trace) {
+		profiler_set_enabled(true);
+	}
+
+	// Don't write a save.dat into the working directory
+	save.is_dirty = false;
+
+	printf(
+		"%-24s %7s %7s %7s %7s %7s %7s %7s %7s\n",
+		"race", "load", "mean", "p50", "p90", "p95", "p99", "max", "audio"
+	);
+
+	for (int race = 0; race < settings.races && !wants_to_exit; race++) {
+		srand(settings.seed + race);
+
+		g.is_attract_mode = true;
+		g.race_type = RACE_TYPE_SINGLE;
+		g.race_class = settings.race_class;
+		g.circut = settings.circut >= 0
+			? settings.circut
+			: race % NUM_NON_BONUS_CIRCUTS;
+		game_set_scene(GAME_SCENE_RACE);
+
+		// The first frame switches the scene and starts loading the track;
+		// the following ones load it step by step
+		scalar_t load_start_time = platform_now();
+		do {
+			system_update();
+		} while (race_is_loading());
+		scalar_t load_time = platform_now() - load_start_time;
+
+		scalar_t audio_time = 0;
+		bench_stats_t stats = {0};
+		for (int frame = 0; frame < settings.frames; frame++) {
+			scalar_t frame_start_time = platform_now();
+			system_update();
+			scalar_t audio_start_time = platform_now();
+			if (audio_callback) {
+				audio_callback(audio_buffer, audio_len);
+			}
+			scalar_t now = platform_now();
+
+			frame_times[frame] = audio_start_time - frame_start_time;
+			bench_stats_add(&stats, render_get_stats());
+			audio_time += now - audio_start_time;
+		}
+
+		char name[32];
+		snprintf(name, sizeof(name), "%d %s", race, def.circuts[g.circut].name);
+		memcpy(all_frame_times + race * settings.frames, frame_times, settings.frames * sizeof(scalar_t));
+		bench_print_times(name, frame_times, settings.frames, load_time, audio_time);
+
+		all_load_time += load_time;
+		all_audio_time += audio_time;
+		race_stats[race] = stats;
+		bench_stats_merge(&all_stats, &stats);
+		races_run++;
+	}
+
+	if (races_run > 0) {
+		bench_print_times(
+			"all", all_frame_times, settings.frames * races_run,
+			all_load_time / races_run, all_audio_time
+		);
+
+		printf(
+			"\n%-24s %7s %7s %7s %7s %7s %9s %7s %7s %7s %7s\n",
+			"race", "flushes", "draws", "tris", "binds", "states", "upload kb", "texs", "atlas", "pages", "hiz"
+		);
+		for (int race = 0; race < races_run; race++) {
+			char name[32];
+			snprintf(name, sizeof(name), "%d %s", race, def.circuts[settings.circut >= 0 ? settings.circut : race % NUM_NON_BONUS_CIRCUTS].name);
+			bench_print_stats(name, &race_stats[race]);
+		}
+		bench_print_stats("all", &all_stats);
+		printf("\n");
+		mem_report();
+	}
+
+	if (settings.profile_csv) {
+		profiler_dump_csv(settings.profile_csv);
+	}
+	if (settings.profile_trace) {
+		profiler_dump_trace(settings.profile_trace);
+	}
+
+	system_cleanup();
+	free(race_stats);
+	free(all_frame_times);
+	free(frame_times);
+	free(audio_buffer);
+	return 0;
+}
@@ -0,0 +1,202 @@
+#include "profiler.h"
+#include "platform.h"
+#include "utils.h"
+
+// The audio mix callback runs on its own thread. Its zone, and frame_start
+// which it reads, are only touched while holding audio_lock. The lock is held
+// for a handful of stores on either side, so spinning on it is fine.
+
+typedef struct {
+	bool running;
+	scalar_t begin;
+	profiler_sample_t current;
+	profiler_sample_t history[PROFILER_HISTORY_LEN];
+} profiler_zone_state_t;
+
+static const char *zone_names[] = {
+	[PROFILER_ZONE_GAME_UPDATE] = "GAME UPDATE",
+	[PROFILER_ZONE_SHIPS_UPDATE] = "SHIPS UPDATE",
+	[PROFILER_ZONE_WEAPONS_UPDATE] = "WEAPONS UPDATE",
+	[PROFILER_ZONE_PARTICLES_UPDATE] = "PARTICLES UPDATE",
+	[PROFILER_ZONE_SCENE_DRAW] = "SCENE DRAW",
+	[PROFILER_ZONE_TRACK_DRAW] = "TRACK DRAW",
+	[PROFILER_ZONE_RENDER_FLUSH] = "RENDER FLUSH",
+	[PROFILER_ZONE_AUDIO_MIX] = "AUDIO MIX",
+};
+
+static profiler_zone_state_t zones[PROFILER_ZONE_MAX];
+static scalar_t frame_start;
+static scalar_t frame_start_history[PROFILER_HISTORY_LEN];
+static uint32_t frames_len = 0;
+static bool enabled = false;
+static bool audio_lock = false;
+
+static inline void profiler_audio_lock() {
+	while (__atomic_test_and_set(&audio_lock, __ATOMIC_ACQUIRE)) {}
+}
+
+static inline void profiler_audio_unlock() {
+	__atomic_clear(&audio_lock, __ATOMIC_RELEASE);
+}
+
+
+void profiler_begin(profiler_zone_t zone) {
+	profiler_zone_state_t *z = &zones[zone];
+	z->running = profiler_is_enabled();
+	if (z->running) {
+		z->begin = platform_now();
+	}
+}
+
+void profiler_end(profiler_zone_t zone) {
+	profiler_zone_state_t *z = &zones[zone];
+	if (!z->running) {
+		return;
+	}
+	z->running = false;
+	scalar_t now = platform_now();
+
+	bool is_audio = (zone == PROFILER_ZONE_AUDIO_MIX);
+	if (is_audio) {
+		profiler_audio_lock();
+	}
+	if (z->current.calls == 0) {
+		z->current.start = z->begin - frame_start;
+	}
+	z->current.duration += now - z->begin;
+	z->current.calls++;
+	if (is_audio) {
+		profiler_audio_unlock();
+	}
+}
+
+void profiler_frame_end() {
+	// Frames while disabled are not recorded, so the history and the dumps
+	// only ever contain frames that were actually measured.
+	bool record = profiler_is_enabled();
+	uint32_t index = frames_len % PROFILER_HISTORY_LEN;
+	scalar_t now = platform_now();
+
+	profiler_audio_lock();
+	if (record) {
+		frame_start_history[index] = frame_start;
+	}
+	for (int i = 0; i < PROFILER_ZONE_MAX; i++) {
+		if (record) {
+			zones[i].history[index] = zones[i].current;
+		}
+		zones[i].current = (profiler_sample_t){0};
+	}
+	frame_start = now;
+	profiler_audio_unlock();
+
+	if (record) {
+		frames_len++;
+	}
+}
+
+void profiler_set_enabled(bool e) {
+	__atomic_store_n(&enabled, e, __ATOMIC_RELAXED);
+}
+
+bool profiler_is_enabled() {
+	return __atomic_load_n(&enabled, __ATOMIC_RELAXED);
+}
+
+const char *profiler_zone_name(profiler_zone_t zone) {
+	return zone_names[zone];
+}
+
+profiler_sample_t profiler_zone_average(profiler_zone_t zone) {
+	profiler_sample_t avg = {0};
+	uint32_t len = min(frames_len, PROFILER_HISTORY_LEN);
+	if (len == 0) {
+		return avg;
+	}
+
+	for (int i = 0; i < len; i++) {
+		profiler_sample_t *s = &zones[zone].history[i];
+		avg.start += s->start;
+		avg.duration += s->duration;
+		avg.calls += s->calls;
+	}
+	avg.start /= len;
+	avg.duration /= len;
+	avg.calls /= len;
+	return avg;
+}
+
+profiler_sample_t profiler_zone_max(profiler_zone_t zone) {
+	profiler_sample_t mx = {0};
+	uint32_t len = min(frames_len, PROFILER_HISTORY_LEN);
+	for (int i = 0; i < len; i++) {
+		profiler_sample_t *s = &zones[zone].history[i];
+		mx.start = max(mx.start, s->start);
+		mx.duration = max(mx.duration, s->duration);
+		mx.calls = max(mx.calls, s->calls);
+	}
+	return mx;
+}
+
+
+
+// Dumps; both write the history from the oldest to the newest frame
+
+void profiler_dump_csv(const char *path) {
+	FILE *f = fopen(path, "wb");
+	error_if(!f, "Could not open file for writing: %s", path);
+
+	fprintf(f, "frame");
+	for (int i = 0; i < PROFILER_ZONE_MAX; i++) {
+		fprintf(f, ",%s ms,%s calls", zone_names[i], zone_names[i]);
+	}
+	fprintf(f, "\n");
+
+	uint32_t len = min(frames_len, PROFILER_HISTORY_LEN);
+	for (int frame = frames_len - len; frame < frames_len; frame++) {
+		uint32_t index = frame % PROFILER_HISTORY_LEN;
+		fprintf(f, "%d", frame);
+		for (int i = 0; i < PROFILER_ZONE_MAX; i++) {
+			profiler_sample_t *s = &zones[i].history[index];
+			fprintf(f, ",%.4f,%d", s->duration * 1000.0, s->calls);
+		}
+		fprintf(f, "\n");
+	}
+
+	fclose(f);
+	printf("wrote %s\n", path);
+}
+
+void profiler_dump_trace(const char *path) {
+	// Chrome trace event format; load with chrome://tracing or Perfetto. Zones
+	// that were entered multiple times in a frame are shown as one event from
+	// their first begin, with their accumulated duration.
+	FILE *f = fopen(path, "wb");
+	error_if(!f, "Could not open file for writing: %s", path);
+
+	fprintf(f, "{\"traceEvents\":[\n");
+	bool first = true;
+	uint32_t len = min(frames_len, PROFILER_HISTORY_LEN);
+	for (int frame = frames_len - len; frame < frames_len; frame++) {
+		uint32_t index = frame % PROFILER_HISTORY_LEN;
+		scalar_t start = frame_start_history[index];
+		for (int i = 0; i < PROFILER_ZONE_MAX; i++) {
+			profiler_sample_t *s = &zones[i].history[index];
+			if (s->calls == 0) {
+				continue;
+			}
+			fprintf(f,
+				"%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f,\"args\":{\"calls\":%d,\"frame\":%d}}",
+				first ? "" : ",\n",
+				zone_names[i], i == PROFILER_ZONE_AUDIO_MIX ? 1 : 0,
+				(start + s->start) * 1000000.0, s->duration * 1000000.0,
+				s->calls, frame
+			);
+			first = false;
+		}
+	}
+	fprintf(f, "\n]}\n");
+
+	fclose(f);
+	printf("wrote %s\n", path);
+}
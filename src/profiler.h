@@ -0,0 +1,47 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "types.h"
+
+#define PROFILER_HISTORY_LEN 128
+
+typedef enum {
+	PROFILER_ZONE_GAME_UPDATE,
+	PROFILER_ZONE_SHIPS_UPDATE,
+	PROFILER_ZONE_WEAPONS_UPDATE,
+	PROFILER_ZONE_PARTICLES_UPDATE,
+	PROFILER_ZONE_SCENE_DRAW,
+	PROFILER_ZONE_TRACK_DRAW,
+	PROFILER_ZONE_RENDER_FLUSH,
+	PROFILER_ZONE_AUDIO_MIX,
+	PROFILER_ZONE_MAX
+} profiler_zone_t;
+
+typedef struct {
+	scalar_t start;    // first begin() in this frame, relative to frame start
+	scalar_t duration; // accumulated time of all begin()/end() pairs
+	uint32_t calls;
+} profiler_sample_t;
+
+// A zone may be entered multiple times per frame; all time spent in it is
+// accumulated. Zones are independent from each other, so they can overlap
+// and nest freely. Each zone must only be used from one thread. Nothing is
+// measured while the profiler is disabled.
+void profiler_begin(profiler_zone_t zone);
+void profiler_end(profiler_zone_t zone);
+
+// Store the accumulated samples of this frame in the history and start the
+// next frame. Called once per frame by the system.
+void profiler_frame_end();
+
+void profiler_set_enabled(bool enabled);
+bool profiler_is_enabled();
+
+const char *profiler_zone_name(profiler_zone_t zone);
+profiler_sample_t profiler_zone_average(profiler_zone_t zone);
+profiler_sample_t profiler_zone_max(profiler_zone_t zone);
+
+void profiler_dump_csv(const char *path);
+void profiler_dump_trace(const char *path);
+
+#endif
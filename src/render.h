@@ -20,6 +20,20 @@ typedef enum {
 	NUM_RENDER_POST_EFFCTS,
 } render_post_effect_t;
 
+typedef struct {
+	uint32_t flushes;
+	uint32_t draw_calls;
+	uint32_t tris;
+	uint32_t bytes_uploaded; // vertex and texture data
+	uint32_t texture_binds;
+	uint32_t state_changes; // blend, depth, cull, matrices and uniforms
+	uint32_t textures_len;
+	float atlas_occupancy; // 0..1, only for renderers using a texture atlas
+	uint32_t atlas_pages;  // atlas pages in use
+	uint32_t hiz_hits;     // 8x8 pixel blocks of tris rejected by depth before
+	uint32_t hiz_misses;   // rasterization, and blocks that were rasterized
+} render_stats_t;
+
 #define RENDER_USE_MIPMAPS 1
 
 #define RENDER_FADEOUT_NEAR 48000.0
@@ -51,16 +65,42 @@ void render_push_matrix();
 void render_pop_matrix();
 
 vec3_t render_transform(vec3_t pos);
+
+// The world space frustum of the current 3d view
+frustum_t render_frustum();
+
 void render_push_tris(tris_t tris, uint16_t texture);
 void render_push_sprite(vec3_t pos, vec2i_t size, rgba_t color, uint16_t texture);
 void render_push_2d(vec2i_t pos, vec2i_t size, rgba_t color, uint16_t texture);
 void render_push_2d_tile(vec2i_t pos, vec2i_t uv_offset, vec2i_t uv_size, vec2i_t size, rgba_t color, uint16_t texture_index);
 
 uint16_t render_texture_create(uint32_t width, uint32_t height, rgba_t *pixels);
+// Same as calling render_texture_create() for each of the len textures in
+// order, but renderers with an atlas may place them in an order that packs
+// better.
+void render_textures_create(uint32_t len, vec2i_t *sizes, rgba_t **pixels);
 vec2i_t render_texture_size(uint16_t texture_index);
 void render_texture_replace_pixels(int16_t texture_index, rgba_t *pixels);
 uint16_t render_textures_len();
 void render_textures_reset(uint16_t len);
 void render_textures_dump(const char *path);
 
+// Returns the stats of the last completed frame
+render_stats_t render_get_stats();
+
+// Static meshes are uploaded once and drawn by tris range with the current
+// model matrix and render state. The tris and the texture index for each tris
+// are not copied and must stay valid for the lifetime of the mesh. After
+// changing tris in place call render_mesh_update() for the changed range.
+// The first quads_len * 2 tris are pairs that form quads; only the two tris
+// of such a pair may share vertices.
+// Renderers without retained vertex buffers link render_mesh_stream.c, which
+// just remembers the tris and pushes them when drawn, so updates are picked up
+// automatically.
+uint16_t render_mesh_create(tris_t *tris, uint16_t *textures, uint32_t len, uint32_t quads_len);
+void render_mesh_update(uint16_t mesh, uint32_t offset, uint32_t len);
+void render_mesh_draw(uint16_t mesh, uint32_t offset, uint32_t len);
+uint16_t render_meshes_len();
+void render_meshes_reset(uint16_t len);
+
 #endif
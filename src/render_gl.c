@@ -33,14 +33,41 @@
 #include "render.h"
 #include "mem.h"
 #include "utils.h"
+#include "profiler.h"
+#include "atlas.h"
 
 
-#define ATLAS_SIZE 64
-#define ATLAS_GRID 32
+// Textures are packed into atlas pages of ATLAS_SIZE x ATLAS_SIZE pixels, 
+// each a separate texture. Positions and sizes in a page are multiples of
+// ATLAS_GRID, so the skyline of a page never has more than 
+// ATLAS_SIZE / ATLAS_GRID nodes.
+#define ATLAS_SIZE 2048
+#define ATLAS_GRID 8
 #define ATLAS_BORDER 16
+#define ATLAS_PAGES_MAX 4
+
+// Mip levels down to ATLAS_MIP_CPU_LEVEL only sample the ATLAS_GRID aligned
+// rect of a texture and are built from its pixels when it is uploaded. A cpu
+// side copy of the page from ATLAS_MIP_CPU_LEVEL down is kept, and the lower
+// levels are rebuilt from it only for the regions that changed.
+#define ATLAS_MIP_LEVELS 12 // 2048 down to 1
+#define ATLAS_MIP_CPU_LEVEL 3
+#define ATLAS_MIP_CPU_SIZE (ATLAS_SIZE >> ATLAS_MIP_CPU_LEVEL)
+#define ATLAS_MIP_CPU_PIXELS (ATLAS_MIP_CPU_SIZE * ATLAS_MIP_CPU_SIZE * 4 / 3 + 1)
+#define ATLAS_MIP_DIRTY_MAX 16
+
+#if (1 << ATLAS_MIP_CPU_LEVEL) > ATLAS_GRID
+	#error "ATLAS_MIP_CPU_LEVEL must not exceed the ATLAS_GRID alignment"
+#endif
 
-#define RENDER_TRIS_BUFFER_CAPACITY 2048
+#define RENDER_TRIS_BUFFER_CAPACITY 8192
+#define RENDER_STREAM_SEGMENTS 3
+#define RENDER_STREAM_SEGMENT_CAPACITY (RENDER_TRIS_BUFFER_CAPACITY * 2)
+#define RENDER_PACKETS_MAX 4096
+#define RENDER_UNIFORMS_MAX 1024
+#define RENDER_PACKET_STREAM 0xffff
 #define TEXTURES_MAX 1024
+#define MESHES_MAX 2048
 
 
 #if defined(__EMSCRIPTEN__) || defined(USE_GLES2)
@@ -54,20 +81,60 @@
 	#define NEAR_PLANE 128.0
 	#define FAR_PLANE (RENDER_FADEOUT_FAR)
 	#define RENDER_DEPTH_BUFFER_INTERNAL_FORMAT GL_DEPTH_COMPONENT16
+
+	// No buffer mapping in WebGL1/GLES2; always upload with glBufferData
+	#define RENDER_STREAM_MAPPING 0
 #else
 	#define SHADER_SOURCE(...) #__VA_ARGS__
 
 	#define NEAR_PLANE 16.0
 	#define FAR_PLANE (RENDER_FADEOUT_FAR)
 	#define RENDER_DEPTH_BUFFER_INTERNAL_FORMAT GL_DEPTH_COMPONENT24
+
+	#if defined(__APPLE__) && defined(__MACH__)
+		#define RENDER_STREAM_MAPPING 0
+	#else
+		#define RENDER_STREAM_MAPPING 1
+	#endif
 #endif
 	
 
 typedef struct {
 	vec2i_t offset;
 	vec2i_t size;
+	uint16_t page;
 } render_texture_t;
 
+// A region of a mip level, from min up to (not including) max
+typedef struct {
+	vec2i_t min;
+	vec2i_t max;
+} render_mip_rect_t;
+
+typedef struct {
+	GLuint texture;
+	atlas_t atlas;
+	rgba_t mip_pixels[ATLAS_MIP_CPU_PIXELS]; // all levels from ATLAS_MIP_CPU_LEVEL
+	render_mip_rect_t mip_dirty[ATLAS_MIP_DIRTY_MAX]; // at ATLAS_MIP_CPU_LEVEL
+	uint32_t mip_dirty_len;
+} render_atlas_page_t;
+
+// The page of all tris of a mesh, or RENDER_MESH_PAGES_MIXED if they use 
+// more than one; the page of each tris is then in pages.
+#define RENDER_MESH_PAGES_MIXED 0xffff
+
+typedef struct {
+	GLuint vbo;
+	GLuint ibo;
+	tris_t *tris;
+	uint16_t *textures;
+	uint8_t *pages;
+	uint16_t page;
+	uint16_t *indices;
+	uint32_t len;
+	uint32_t quads_len;
+} render_mesh_t;
+
 uint16_t RENDER_NO_TEXTURE;
 
 #define use_program(SHADER) \
@@ -145,7 +212,7 @@ static const char * const SHADER_GAME_VS = SHADER_SOURCE(
 			fade.y, fade.x, // fadeout far, near
 			length(vec4(camera_pos, 1.0) - model * vec4(pos, 1.0))
 		);
-		v_uv = uv / 2048.0; // ATLAS_GRID * ATLAS_SIZE
+		v_uv = uv / 2048.0; // ATLAS_SIZE
 	}
 );
 
@@ -350,17 +417,91 @@ prg_post_t *shader_post_crt_init() {
 
 // -----------------------------------------------------------------------------
 
+typedef enum {
+	RENDER_STREAM_BUFFER_DATA,
+	RENDER_STREAM_MAP_RANGE,
+	RENDER_STREAM_PERSISTENT
+} render_stream_mode_t;
+
+typedef struct {
+	render_blend_mode_t blend_mode;
+	bool depth_write;
+	bool depth_test;
+	bool cull_backface;
+	float depth_offset;
+} render_state_t;
+
+typedef struct {
+	mat4_t view;
+	mat4_t model;
+	mat4_t projection;
+	vec3_t camera_pos;
+	vec2_t screen;
+	vec2_t fade;
+} render_uniforms_t;
+
+// A draw of a range of tris, either from the stream buffer or from a mesh,
+// with the render state and uniforms that were set when it was pushed. All
+// tris of a packet use textures from the same atlas page.
+typedef struct {
+	render_state_t state;
+	uint16_t uniforms;
+	uint16_t mesh;
+	uint16_t page;
+	uint32_t first;
+	uint32_t len;
+} render_packet_t;
+
 static GLuint vbo;
 
-static tris_t tris_buffer[RENDER_TRIS_BUFFER_CAPACITY];
+// Tris are pushed into tris_buffer until it is full or the frame ends. With
+// a persistent mapped vbo tris_buffer points directly into the mapped 
+// segment; otherwise it's the cpu side buffer and its contents are copied
+// into the vbo on flush.
+static tris_t tris_buffer_cpu[RENDER_TRIS_BUFFER_CAPACITY];
+static tris_t *tris_buffer = tris_buffer_cpu;
 static uint32_t tris_len = 0;
 
+static render_stream_mode_t stream_mode = RENDER_STREAM_BUFFER_DATA;
+#if RENDER_STREAM_MAPPING
+	static tris_t *stream_mapped = NULL;
+	static uint32_t stream_offset = 0; // in tris, from the start of the vbo
+	static uint32_t stream_segment = 0;
+	static bool stream_segment_is_full = false;
+	static GLsync stream_fences[RENDER_STREAM_SEGMENTS] = {};
+#endif
+
 static vec2i_t screen_size;
 static vec2i_t backbuffer_size;
 
-static uint32_t atlas_map[ATLAS_SIZE] = {0};
-static GLuint atlas_texture = 0;
-static render_blend_mode_t blend_mode = RENDER_BLEND_NORMAL;
+// All draws of a frame are recorded as packets and only executed in
+// render_flush(). The render_set_*() functions just change the current state
+// and uniforms that are recorded with the next packets.
+static render_packet_t packets[RENDER_PACKETS_MAX];
+static uint32_t packets_len = 0;
+static render_uniforms_t uniforms_buffer[RENDER_UNIFORMS_MAX];
+static uint32_t uniforms_len = 0;
+
+static render_state_t state = {
+	.blend_mode = RENDER_BLEND_NORMAL,
+	.depth_write = true,
+	.depth_test = true,
+	.cull_backface = true,
+	.depth_offset = 0
+};
+static render_uniforms_t uniforms;
+static bool uniforms_changed = true;
+
+static render_state_t applied_state;
+static render_uniforms_t applied_uniforms;
+static bool applied_is_valid = false;
+
+static render_atlas_page_t atlas_pages[ATLAS_PAGES_MAX];
+static uint32_t atlas_pages_len = 0;
+static GLint atlas_min_filter = RENDER_USE_MIPMAPS ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+
+static render_stats_t stats = {0};
+static render_stats_t stats_last_frame = {0};
 
 static mat4_t projection_mat_2d = mat4_identity();
 static mat4_t projection_mat_bb = mat4_identity();
@@ -371,7 +512,9 @@ static mat4_t view_mat = mat4_identity();
 
 static render_texture_t textures[TEXTURES_MAX];
 static uint32_t textures_len = 0;
-static bool texture_mipmap_is_dirty = false;
+
+static render_mesh_t meshes[MESHES_MAX];
+static uint32_t meshes_len = 0;
 
 static render_resolution_t render_res;
 static GLuint backbuffer = 0;
@@ -384,6 +527,11 @@ prg_post_t *prg_post_effects[NUM_RENDER_POST_EFFCTS] = {};
 
 
 static void render_flush();
+static uint32_t render_atlas_page_add();
+static void render_update_mipmaps();
+static void render_stream_init();
+static uint32_t render_stream_upload();
+static void render_stream_next_segment();
 
 
 // static void gl_message_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *message, const void *userParam) {
@@ -405,29 +553,16 @@ void render_init(vec2i_t screen_size) {
 	// glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
 
 
-	// Atlas Texture
-
-	glGenTextures(1, &atlas_texture);
-	glBindTexture(GL_TEXTURE_2D, atlas_texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, RENDER_USE_MIPMAPS ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	// Atlas Texture; more pages are added when needed
 
-	float anisotropy = 0;
-	glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &anisotropy);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
+	render_atlas_page_add();
 
-	uint32_t tw = ATLAS_SIZE * ATLAS_GRID;
-	uint32_t th = ATLAS_SIZE * ATLAS_GRID;
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tw, th, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-	printf("atlas texture %5d\n", atlas_texture);
-	
 
 	// Tris buffer
 
 	glGenBuffers(1, &vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	render_stream_init();
 
 
 	// Post Shaders
@@ -513,6 +648,7 @@ void render_set_screen_size(vec2i_t size) {
 
 
 void render_set_resolution(render_resolution_t res) {
+	render_flush();
 	render_res = res;
 
 	if (res == RENDER_RES_NATIVE) {
@@ -557,12 +693,15 @@ void render_set_resolution(render_resolution_t res) {
 
 
 	// Use nearest texture min filter for 240p and 480p
-	glBindTexture(GL_TEXTURE_2D, atlas_texture);
 	if (res == RENDER_RES_NATIVE) {
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, RENDER_USE_MIPMAPS ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		atlas_min_filter = RENDER_USE_MIPMAPS ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
 	}
 	else {
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		atlas_min_filter = GL_NEAREST;
+	}
+	for (int i = 0; i < atlas_pages_len; i++) {
+		glBindTexture(GL_TEXTURE_2D, atlas_pages[i].texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, atlas_min_filter);
 	}
 	glViewport(0, 0, backbuffer_size.x, backbuffer_size.y);
 }
@@ -581,14 +720,18 @@ void render_frame_prepare() {
 	glBindFramebuffer(GL_FRAMEBUFFER, backbuffer);
 	glViewport(0, 0, backbuffer_size.x, backbuffer_size.y);
 
-	glBindTexture(GL_TEXTURE_2D, atlas_texture);
-	glUniform2f(prg_game->uniform.screen, 0, 0);
-	glEnable(GL_DEPTH_TEST);
+	// The atlas page is bound with the first packet
+	render_set_screen_position(vec2(0, 0));
+	render_set_depth_test(true);
+	render_set_depth_write(true);
+	render_set_depth_offset(0);
+
+	// The clear needs depth writes enabled; everything else is applied again
+	// with the first packet
 	glDepthMask(true);
-	glDisable(GL_POLYGON_OFFSET_FILL);
 	glClearColor(0, 0, 0, 1);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glEnable(GL_DEPTH_TEST); 
+	applied_is_valid = false;
 }
 
 void render_frame_end() {
@@ -599,6 +742,7 @@ void render_frame_end() {
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glViewport(0, 0, screen_size.x, screen_size.y);
 	glBindTexture(GL_TEXTURE_2D, backbuffer_texture);
+	stats.texture_binds++;
 	glUniformMatrix4fv(prg_post->uniform.projection, 1, false, projection_mat_bb.m);
 	glUniform1f(prg_post->uniform.time, system_cycle_time());
 	glUniform2f(prg_post->uniform.screen_size, screen_size.x, screen_size.y);
@@ -606,6 +750,8 @@ void render_frame_end() {
 	glClearColor(0, 0, 0, 1);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	// Draw the backbuffer directly, without going through the packets of the
+	// game shader
 	rgba_t white = rgba(128,128,128,255);
 	tris_buffer[tris_len++] = (tris_t){
 		.vertices = {
@@ -622,28 +768,542 @@ void render_frame_end() {
 		}
 	};
 
-	render_flush();
+	uint32_t first = render_stream_upload();
+	glDrawArrays(GL_TRIANGLES, first * 3, 6);
+	stats.draw_calls++;
+	stats.tris += 2;
+	render_stream_next_segment();
+	applied_is_valid = false;
+
+	// Pages stay allocated after a texture reset; only count those in use
+	uint32_t atlas_used = 0;
+	for (int i = 0; i < atlas_pages_len; i++) {
+		if (atlas_pages[i].atlas.used_area > 0) {
+			atlas_used += atlas_pages[i].atlas.used_area;
+			stats.atlas_pages = i + 1;
+		}
+	}
+	stats.textures_len = textures_len;
+	stats.atlas_occupancy = stats.atlas_pages 
+		? (float)atlas_used / (stats.atlas_pages * ATLAS_SIZE * ATLAS_SIZE)
+		: 0;
+	stats_last_frame = stats;
+	stats = (render_stats_t){0};
+}
+
+render_stats_t render_get_stats() {
+	return stats_last_frame;
+}
+
+static inline bool render_state_equals(render_state_t *a, render_state_t *b) {
+	return
+		a->blend_mode == b->blend_mode &&
+		a->depth_write == b->depth_write &&
+		a->depth_test == b->depth_test &&
+		a->cull_backface == b->cull_backface &&
+		a->depth_offset == b->depth_offset;
+}
+
+static inline bool render_state_is_opaque(render_state_t *s) {
+	return s->depth_write && s->depth_test && s->blend_mode == RENDER_BLEND_NORMAL;
+}
+
+static inline bool render_packet_compare(render_packet_t *a, render_packet_t *b) {
+	// Returns true if a should be drawn after b. Uniforms are in the order
+	// they were set, which for objects is front to back (see visibility.c), 
+	// so they come before the atlas page: most frames only use one page, and
+	// keeping the depth order saves more than the extra texture binds cost.
+	if (a->state.cull_backface != b->state.cull_backface) {
+		return a->state.cull_backface > b->state.cull_backface;
+	}
+	if (a->state.depth_offset != b->state.depth_offset) {
+		return a->state.depth_offset > b->state.depth_offset;
+	}
+	if (a->uniforms != b->uniforms) {
+		return a->uniforms > b->uniforms;
+	}
+	if (a->mesh != b->mesh) {
+		return a->mesh > b->mesh;
+	}
+	if (a->page != b->page) {
+		return a->page > b->page;
+	}
+	return a->first > b->first;
+}
+
+// Stable bottom up merge sort; a flush can have thousands of packets
+static void render_packets_sort(render_packet_t *list, uint32_t len) {
+	static render_packet_t temp[RENDER_PACKETS_MAX];
+	render_packet_t *src = list;
+	render_packet_t *dst = temp;
+
+	for (uint32_t width = 1; width < len; width *= 2) {
+		for (uint32_t start = 0; start < len; start += width * 2) {
+			uint32_t mid = min(start + width, len);
+			uint32_t end = min(start + width * 2, len);
+			uint32_t l = start, r = mid, d = start;
+			while (l < mid && r < end) {
+				dst[d++] = render_packet_compare(&src[l], &src[r]) ? src[r++] : src[l++];
+			}
+			while (l < mid) {
+				dst[d++] = src[l++];
+			}
+			while (r < end) {
+				dst[d++] = src[r++];
+			}
+		}
+		swap(src, dst);
+	}
+
+	if (src != list) {
+		memcpy(list, src, sizeof(render_packet_t) * len);
+	}
+}
+
+static void render_packets_reserve() {
+	if (
+		packets_len >= RENDER_PACKETS_MAX ||
+		(uniforms_changed && uniforms_len >= RENDER_UNIFORMS_MAX)
+	) {
+		render_flush();
+	}
+}
+
+static void render_packets_push(uint16_t mesh, uint16_t page, uint32_t first, uint32_t len) {
+	if (uniforms_changed) {
+		uniforms_buffer[uniforms_len++] = uniforms;
+		uniforms_changed = false;
+	}
+	uint16_t uniforms_index = uniforms_len - 1;
+
+	if (packets_len > 0) {
+		render_packet_t *last = &packets[packets_len - 1];
+		if (
+			last->mesh == mesh && 
+			last->page == page &&
+			last->uniforms == uniforms_index && 
+			last->first + last->len == first &&
+			render_state_equals(&last->state, &state)
+		) {
+			last->len += len;
+			return;
+		}
+	}
+
+	packets[packets_len++] = (render_packet_t){
+		.state = state,
+		.uniforms = uniforms_index,
+		.mesh = mesh,
+		.page = page,
+		.first = first,
+		.len = len
+	};
+}
+
+static bool render_packets_use_mesh(uint16_t mesh) {
+	for (uint32_t i = 0; i < packets_len; i++) {
+		if (packets[i].mesh == mesh) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void render_apply_state(render_state_t *s) {
+	render_state_t *a = &applied_state;
+	bool all = !applied_is_valid;
+
+	if (all || a->blend_mode != s->blend_mode) {
+		stats.state_changes++;
+		if (s->blend_mode == RENDER_BLEND_NORMAL) {
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		}
+		else if (s->blend_mode == RENDER_BLEND_LIGHTER) {
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+		}
+	}
+	if (all || a->depth_write != s->depth_write) {
+		stats.state_changes++;
+		glDepthMask(s->depth_write);
+	}
+	if (all || a->depth_test != s->depth_test) {
+		stats.state_changes++;
+		if (s->depth_test) {
+			glEnable(GL_DEPTH_TEST);
+		}
+		else {
+			glDisable(GL_DEPTH_TEST);
+		}
+	}
+	if (all || a->cull_backface != s->cull_backface) {
+		stats.state_changes++;
+		if (s->cull_backface) {
+			glEnable(GL_CULL_FACE);
+		}
+		else {
+			glDisable(GL_CULL_FACE);
+		}
+	}
+	if (all || a->depth_offset != s->depth_offset) {
+		stats.state_changes++;
+		if (s->depth_offset == 0) {
+			glDisable(GL_POLYGON_OFFSET_FILL);
+		}
+		else {
+			glEnable(GL_POLYGON_OFFSET_FILL);
+			glPolygonOffset(s->depth_offset, 1.0);
+		}
+	}
+	*a = *s;
+}
+
+static void render_apply_uniforms(render_uniforms_t *u) {
+	render_uniforms_t *a = &applied_uniforms;
+	bool all = !applied_is_valid;
+
+	if (all || memcmp(&a->view, &u->view, sizeof(mat4_t)) != 0) {
+		stats.state_changes++;
+		glUniformMatrix4fv(prg_game->uniform.view, 1, false, u->view.m);
+	}
+	if (all || memcmp(&a->model, &u->model, sizeof(mat4_t)) != 0) {
+		stats.state_changes++;
+		glUniformMatrix4fv(prg_game->uniform.model, 1, false, u->model.m);
+	}
+	if (all || memcmp(&a->projection, &u->projection, sizeof(mat4_t)) != 0) {
+		stats.state_changes++;
+		glUniformMatrix4fv(prg_game->uniform.projection, 1, false, u->projection.m);
+	}
+	if (all || memcmp(&a->camera_pos, &u->camera_pos, sizeof(vec3_t)) != 0) {
+		stats.state_changes++;
+		glUniform3f(prg_game->uniform.camera_pos, u->camera_pos.x, u->camera_pos.y, u->camera_pos.z);
+	}
+	if (all || memcmp(&a->screen, &u->screen, sizeof(vec2_t)) != 0) {
+		stats.state_changes++;
+		glUniform2f(prg_game->uniform.screen, u->screen.x, u->screen.y);
+	}
+	if (all || memcmp(&a->fade, &u->fade, sizeof(vec2_t)) != 0) {
+		stats.state_changes++;
+		glUniform2f(prg_game->uniform.fade, u->fade.x, u->fade.y);
+	}
+	*a = *u;
+}
+
+static void render_bind_vertex_buffer(GLuint vertex_buffer, GLuint index_buffer) {
+	stats.state_changes++;
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+	bind_va_f(prg_game->attribute.pos, vertex_t, pos, 0);
+	bind_va_f(prg_game->attribute.uv, vertex_t, uv, 0);
+	bind_va_color(prg_game->attribute.color, vertex_t, color, 0);
 }
 
 void render_flush() {
-	if (tris_len == 0) {
+	if (packets_len == 0) {
 		return;
 	}
 
-	if (texture_mipmap_is_dirty) {
-		glGenerateMipmap(GL_TEXTURE_2D);
-		texture_mipmap_is_dirty = false;
+	profiler_begin(PROFILER_ZONE_RENDER_FLUSH);
+	stats.flushes++;
+	render_update_mipmaps();
+	uint32_t stream_first = render_stream_upload();
+
+	// Opaque packets between two translucent ones can be drawn in any order;
+	// sort them by state so that they can be merged into fewer draw calls. 
+	// Translucent packets keep their order.
+	for (uint32_t run_start = 0, i = 0; i <= packets_len; i++) {
+		if (i == packets_len || !render_state_is_opaque(&packets[i].state)) {
+			render_packets_sort(packets + run_start, i - run_start);
+			run_start = i + 1;
+		}
+	}
+
+	uint16_t bound_mesh = RENDER_PACKET_STREAM;
+	int32_t bound_page = -1;
+	for (uint32_t i = 0; i < packets_len; i++) {
+		render_packet_t *p = &packets[i];
+		uint32_t len = p->len;
+		while (
+			i + 1 < packets_len &&
+			packets[i + 1].mesh == p->mesh &&
+			packets[i + 1].page == p->page &&
+			packets[i + 1].uniforms == p->uniforms &&
+			packets[i + 1].first == p->first + len &&
+			render_state_equals(&packets[i + 1].state, &p->state)
+		) {
+			len += packets[++i].len;
+		}
+
+		render_apply_state(&p->state);
+		render_apply_uniforms(&uniforms_buffer[p->uniforms]);
+		applied_is_valid = true;
+
+		if (bound_page != p->page) {
+			glBindTexture(GL_TEXTURE_2D, atlas_pages[p->page].texture);
+			stats.texture_binds++;
+			bound_page = p->page;
+		}
+
+		if (p->mesh == RENDER_PACKET_STREAM) {
+			if (bound_mesh != RENDER_PACKET_STREAM) {
+				render_bind_vertex_buffer(vbo, 0);
+				bound_mesh = RENDER_PACKET_STREAM;
+			}
+			glDrawArrays(GL_TRIANGLES, (stream_first + p->first) * 3, len * 3);
+		}
+		else {
+			if (bound_mesh != p->mesh) {
+				render_bind_vertex_buffer(meshes[p->mesh].vbo, meshes[p->mesh].ibo);
+				bound_mesh = p->mesh;
+			}
+			glDrawElements(GL_TRIANGLES, len * 3, GL_UNSIGNED_SHORT, (GLvoid*)(p->first * 3 * sizeof(uint16_t)));
+		}
+		stats.draw_calls++;
+		stats.tris += len;
+	}
+
+	if (bound_mesh != RENDER_PACKET_STREAM) {
+		render_bind_vertex_buffer(vbo, 0);
+	}
+
+	#if RENDER_STREAM_MAPPING
+		if (stream_segment_is_full) {
+			render_stream_next_segment();
+		}
+	#endif
+
+	packets_len = 0;
+	uniforms_len = 0;
+	uniforms_changed = true;
+	profiler_end(PROFILER_ZONE_RENDER_FLUSH);
+}
+
+static uint32_t render_stream_upload() {
+	if (tris_len == 0) {
+		return 0;
 	}
 
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(tris_t) * tris_len, tris_buffer, GL_DYNAMIC_DRAW);
-	glDrawArrays(GL_TRIANGLES, 0, tris_len * 3);
+	stats.bytes_uploaded += sizeof(tris_t) * tris_len;
+	uint32_t first = 0;
+
+	#if RENDER_STREAM_MAPPING
+		if (stream_mode == RENDER_STREAM_PERSISTENT) {
+			// The tris have already been written to the mapped buffer
+			first = stream_offset;
+			stream_offset += tris_len;
+			// The segment is only fenced after the draws reading from it have
+			// been issued; the caller moves on with render_stream_next_segment()
+			if (stream_offset + RENDER_TRIS_BUFFER_CAPACITY > (stream_segment + 1) * RENDER_STREAM_SEGMENT_CAPACITY) {
+				stream_segment_is_full = true;
+			}
+			else {
+				tris_buffer = stream_mapped + stream_offset;
+			}
+		}
+		else if (stream_mode == RENDER_STREAM_MAP_RANGE) {
+			// Orphan the buffer when we reach the end and start from the
+			// beginning; the driver keeps the old storage alive for draws
+			// still in flight
+			if (stream_offset + tris_len > RENDER_STREAM_SEGMENTS * RENDER_STREAM_SEGMENT_CAPACITY) {
+				glBufferData(GL_ARRAY_BUFFER, sizeof(tris_t) * RENDER_STREAM_SEGMENTS * RENDER_STREAM_SEGMENT_CAPACITY, NULL, GL_STREAM_DRAW);
+				stream_offset = 0;
+			}
+			void *dst = glMapBufferRange(
+				GL_ARRAY_BUFFER, sizeof(tris_t) * stream_offset, sizeof(tris_t) * tris_len,
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+			);
+			memcpy(dst, tris_buffer, sizeof(tris_t) * tris_len);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			first = stream_offset;
+			stream_offset += tris_len;
+		}
+		else
+	#endif
+	{
+		glBufferData(GL_ARRAY_BUFFER, sizeof(tris_t) * tris_len, tris_buffer, GL_DYNAMIC_DRAW);
+	}
+
 	tris_len = 0;
+	return first;
+}
+
+static void render_stream_init() {
+	#if RENDER_STREAM_MAPPING
+		uint32_t size = sizeof(tris_t) * RENDER_STREAM_SEGMENTS * RENDER_STREAM_SEGMENT_CAPACITY;
+		if ((GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) && (GLEW_VERSION_3_2 || GLEW_ARB_sync)) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+			stream_mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+			if (stream_mapped) {
+				stream_mode = RENDER_STREAM_PERSISTENT;
+				stream_segment = 0;
+				stream_offset = 0;
+				tris_buffer = stream_mapped;
+				printf("tris stream: persistent mapped, %d kb\n", size / 1024);
+				return;
+			}
+
+			// Storage of a buffer object is immutable after glBufferStorage;
+			// start over with a new one.
+			glDeleteBuffers(1, &vbo);
+			glGenBuffers(1, &vbo);
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		}
+
+		if (GLEW_VERSION_3_0 || GLEW_ARB_map_buffer_range) {
+			glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+			stream_mode = RENDER_STREAM_MAP_RANGE;
+			stream_offset = 0;
+			printf("tris stream: map buffer range, %d kb\n", size / 1024);
+			return;
+		}
+	#endif
+
+	stream_mode = RENDER_STREAM_BUFFER_DATA;
+	printf("tris stream: buffer data\n");
+}
+
+static void render_stream_next_segment() {
+	#if RENDER_STREAM_MAPPING
+		if (stream_mode != RENDER_STREAM_PERSISTENT) {
+			return;
+		}
+
+		// Fence the segment we just wrote, then wait until the GPU is done
+		// with the next one before we write into it again
+		if (stream_fences[stream_segment]) {
+			glDeleteSync(stream_fences[stream_segment]);
+		}
+		stream_fences[stream_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		stream_segment = (stream_segment + 1) % RENDER_STREAM_SEGMENTS;
+		GLsync fence = stream_fences[stream_segment];
+		if (fence) {
+			while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+			glDeleteSync(fence);
+			stream_fences[stream_segment] = NULL;
+		}
+
+		stream_offset = stream_segment * RENDER_STREAM_SEGMENT_CAPACITY;
+		stream_segment_is_full = false;
+		tris_buffer = stream_mapped + stream_offset;
+	#endif
+}
+
+// 2x2 box filter from src into dst; width and height are those of dst
+static void render_mip_downsample(rgba_t *dst, uint32_t dst_stride, rgba_t *src, uint32_t src_stride, uint32_t width, uint32_t height) {
+	for (uint32_t y = 0; y < height; y++) {
+		rgba_t *d = dst + y * dst_stride;
+		rgba_t *s0 = src + y * 2 * src_stride;
+		rgba_t *s1 = s0 + src_stride;
+		for (uint32_t x = 0; x < width; x++) {
+			uint8_t *a = s0[x * 2].as_components;
+			uint8_t *b = s0[x * 2 + 1].as_components;
+			uint8_t *c = s1[x * 2].as_components;
+			uint8_t *e = s1[x * 2 + 1].as_components;
+			for (int i = 0; i < 4; i++) {
+				d[x].as_components[i] = (a[i] + b[i] + c[i] + e[i] + 2) >> 2;
+			}
+		}
+	}
+}
+
+static rgba_t *render_atlas_mip_level(render_atlas_page_t *page, uint32_t level) {
+	rgba_t *pixels = page->mip_pixels;
+	for (uint32_t l = ATLAS_MIP_CPU_LEVEL; l < level; l++) {
+		pixels += (ATLAS_SIZE >> l) * (ATLAS_SIZE >> l);
+	}
+	return pixels;
+}
+
+static void render_atlas_mip_mark_dirty(render_atlas_page_t *page, render_mip_rect_t rect) {
+	// If there are too many regions, merge them all into one
+	if (page->mip_dirty_len == ATLAS_MIP_DIRTY_MAX) {
+		for (int i = 1; i < page->mip_dirty_len; i++) {
+			page->mip_dirty[0].min.x = min(page->mip_dirty[0].min.x, page->mip_dirty[i].min.x);
+			page->mip_dirty[0].min.y = min(page->mip_dirty[0].min.y, page->mip_dirty[i].min.y);
+			page->mip_dirty[0].max.x = max(page->mip_dirty[0].max.x, page->mip_dirty[i].max.x);
+			page->mip_dirty[0].max.y = max(page->mip_dirty[0].max.y, page->mip_dirty[i].max.y);
+		}
+		page->mip_dirty_len = 1;
+	}
+	page->mip_dirty[page->mip_dirty_len++] = rect;
+}
+
+// Build the mip levels of a newly uploaded ATLAS_GRID aligned rect down to
+// ATLAS_MIP_CPU_LEVEL, and mark the region for the levels below
+static void render_atlas_mip_upload(render_atlas_page_t *page, vec2i_t pos, vec2i_t size, rgba_t *pixels) {
+	uint32_t w1 = size.x >> 1;
+	uint32_t h1 = size.y >> 1;
+	rgba_t *temp = mem_temp_alloc(sizeof(rgba_t) * (w1 * h1 + (w1 >> 1) * (h1 >> 1)));
+	rgba_t *buffers[2] = {temp, temp + w1 * h1};
+
+	rgba_t *src = pixels;
+	uint32_t src_stride = size.x;
+	for (uint32_t level = 1; level <= ATLAS_MIP_CPU_LEVEL; level++) {
+		uint32_t w = size.x >> level;
+		uint32_t h = size.y >> level;
+		rgba_t *dst = buffers[(level - 1) & 1];
+		render_mip_downsample(dst, w, src, src_stride, w, h);
+		glTexSubImage2D(GL_TEXTURE_2D, level, pos.x >> level, pos.y >> level, w, h, GL_RGBA, GL_UNSIGNED_BYTE, dst);
+		stats.bytes_uploaded += w * h * sizeof(rgba_t);
+		src = dst;
+		src_stride = w;
+	}
+
+	render_mip_rect_t rect = {
+		.min = vec2i(pos.x >> ATLAS_MIP_CPU_LEVEL, pos.y >> ATLAS_MIP_CPU_LEVEL),
+		.max = vec2i((pos.x + size.x) >> ATLAS_MIP_CPU_LEVEL, (pos.y + size.y) >> ATLAS_MIP_CPU_LEVEL)
+	};
+	rgba_t *cpu_level = render_atlas_mip_level(page, ATLAS_MIP_CPU_LEVEL);
+	for (uint32_t y = rect.min.y; y < rect.max.y; y++) {
+		memcpy(
+			cpu_level + y * ATLAS_MIP_CPU_SIZE + rect.min.x, 
+			src + (y - rect.min.y) * src_stride, 
+			src_stride * sizeof(rgba_t)
+		);
+	}
+	mem_temp_free(temp);
+	render_atlas_mip_mark_dirty(page, rect);
+}
+
+// Rebuild the levels below ATLAS_MIP_CPU_LEVEL for all changed regions. Each
+// region is uploaded as whole rows of the level, which are at most 
+// ATLAS_MIP_CPU_SIZE / 2 wide and contiguous in the cpu side copy.
+static void render_update_mipmaps() {
+	for (int i = 0; i < atlas_pages_len; i++) {
+		render_atlas_page_t *page = &atlas_pages[i];
+		if (page->mip_dirty_len == 0) {
+			continue;
+		}
+
+		glBindTexture(GL_TEXTURE_2D, page->texture);
+		stats.texture_binds++;
+		for (int r = 0; r < page->mip_dirty_len; r++) {
+			render_mip_rect_t rect = page->mip_dirty[r];
+			for (uint32_t level = ATLAS_MIP_CPU_LEVEL + 1; level < ATLAS_MIP_LEVELS; level++) {
+				rect.min = vec2i(rect.min.x >> 1, rect.min.y >> 1);
+				rect.max = vec2i((rect.max.x + 1) >> 1, (rect.max.y + 1) >> 1);
+				uint32_t w = ATLAS_SIZE >> level;
+				rgba_t *src = render_atlas_mip_level(page, level - 1);
+				rgba_t *dst = render_atlas_mip_level(page, level);
+				render_mip_downsample(
+					dst + rect.min.y * w + rect.min.x, w, 
+					src + rect.min.y * 2 * (w * 2) + rect.min.x * 2, w * 2,
+					rect.max.x - rect.min.x, rect.max.y - rect.min.y
+				);
+
+				uint32_t rows = rect.max.y - rect.min.y;
+				glTexSubImage2D(GL_TEXTURE_2D, level, 0, rect.min.y, w, rows, GL_RGBA, GL_UNSIGNED_BYTE, dst + rect.min.y * w);
+				stats.bytes_uploaded += w * rows * sizeof(rgba_t);
+			}
+		}
+		page->mip_dirty_len = 0;
+	}
 }
 
 
 void render_set_view(vec3_t pos, vec3_t angles) {
-	render_flush();
 	render_set_depth_write(true);
 	render_set_depth_test(true);
 
@@ -655,86 +1315,55 @@ void render_set_view(vec3_t pos, vec3_t angles) {
 
 	render_set_model_mat(&mat4_identity());
 
-	render_flush();
-	glUniformMatrix4fv(prg_game->uniform.view, 1, false, view_mat.m);
-	glUniformMatrix4fv(prg_game->uniform.projection, 1, false, projection_mat_3d.m);
-	glUniform3f(prg_game->uniform.camera_pos, pos.x, pos.y, pos.z);
-	glUniform2f(prg_game->uniform.fade, RENDER_FADEOUT_NEAR, RENDER_FADEOUT_FAR);
+	uniforms.view = view_mat;
+	uniforms.projection = projection_mat_3d;
+	uniforms.camera_pos = pos;
+	uniforms.fade = vec2(RENDER_FADEOUT_NEAR, RENDER_FADEOUT_FAR);
+	uniforms_changed = true;
 }
 
 void render_set_view_2d() {
-	render_flush();
 	render_set_depth_test(false);
 	render_set_depth_write(false);
 
 	render_set_model_mat(&mat4_identity());
-	glUniform3f(prg_game->uniform.camera_pos, 0, 0, 0);
-	glUniformMatrix4fv(prg_game->uniform.view, 1, false, mat4_identity().m);
-	glUniformMatrix4fv(prg_game->uniform.projection, 1, false, projection_mat_2d.m);
+	uniforms.camera_pos = vec3(0, 0, 0);
+	uniforms.view = mat4_identity();
+	uniforms.projection = projection_mat_2d;
+	uniforms_changed = true;
 }
 
 void render_set_model_mat(mat4_t *m) {
-	render_flush();
-	glUniformMatrix4fv(prg_game->uniform.model, 1, false, m->m);
+	uniforms.model = *m;
+	uniforms_changed = true;
 }
 
 void render_push_matrix() { }
 void render_pop_matrix() { }
 
 void render_set_depth_write(bool enabled) {
-	render_flush();
-	glDepthMask(enabled);
+	state.depth_write = enabled;
 }
 
 void render_set_depth_test(bool enabled) {
-	render_flush();
-	if (enabled) {
-		glEnable(GL_DEPTH_TEST);
-	}
-	else {
-		glDisable(GL_DEPTH_TEST); 
-	}
+	state.depth_test = enabled;
 }
 
 void render_set_depth_offset(float offset) {
-	render_flush();
-	if (offset == 0) {
-		glDisable(GL_POLYGON_OFFSET_FILL);
-		return;	
-	}
-
-	glEnable(GL_POLYGON_OFFSET_FILL);
-	glPolygonOffset(offset, 1.0);
+	state.depth_offset = offset;
 }
 
 void render_set_screen_position(vec2_t pos) {
-	render_flush();
-	glUniform2f(prg_game->uniform.screen, pos.x, -pos.y);
+	uniforms.screen = vec2(pos.x, -pos.y);
+	uniforms_changed = true;
 }
 
 void render_set_blend_mode(render_blend_mode_t new_mode) {
-	if (new_mode == blend_mode) {
-		return;
-	}
-	render_flush();
-
-	blend_mode = new_mode;
-	if (blend_mode == RENDER_BLEND_NORMAL) {
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	}
-	else if (blend_mode == RENDER_BLEND_LIGHTER) {
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-	}
+	state.blend_mode = new_mode;
 }
 
 void render_set_cull_backface(bool enabled) {
-	render_flush();
-	if (enabled) {
-		glEnable(GL_CULL_FACE);
-	}
-	else {
-		glDisable(GL_CULL_FACE);
-	}
+	state.cull_backface = enabled;
 }
 
 
@@ -744,12 +1373,19 @@ vec3_t render_transform(vec3_t pos) {
 	return vec3_transform(vec3_transform(pos, &view_mat), &projection_mat_3d);
 }
 
+frustum_t render_frustum() {
+	mat4_t view_projection;
+	mat4_mul(&view_projection, &projection_mat_3d, &view_mat);
+	return frustum_from_mat4(&view_projection);
+}
+
 void render_push_tris(tris_t tris, uint16_t texture_index) {
 	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
 	
 	if (tris_len >= RENDER_TRIS_BUFFER_CAPACITY) {
 		render_flush();
 	}
+	render_packets_reserve();
 
 	render_texture_t *t = &textures[texture_index];
 
@@ -757,6 +1393,7 @@ void render_push_tris(tris_t tris, uint16_t texture_index) {
 		tris.vertices[i].uv.x += t->offset.x;
 		tris.vertices[i].uv.y += t->offset.y;
 	}
+	render_packets_push(RENDER_PACKET_STREAM, t->page, tris_len, 1);
 	tris_buffer[tris_len++] = tris;
 }
 
@@ -857,98 +1494,164 @@ void render_push_2d_tile(vec2i_t pos, vec2i_t uv_offset, vec2i_t uv_size, vec2i_
 }
 
 
-uint16_t render_texture_create(uint32_t tw, uint32_t th, rgba_t *pixels) {
-	error_if(textures_len >= TEXTURES_MAX, "TEXTURES_MAX reached");
+static uint32_t render_atlas_page_add() {
+	error_if(atlas_pages_len >= ATLAS_PAGES_MAX, "Render atlas ran out of space");
 
-	uint32_t bw = tw + ATLAS_BORDER * 2;
-	uint32_t bh = th + ATLAS_BORDER * 2;
+	render_atlas_page_t *page = &atlas_pages[atlas_pages_len];
+	glGenTextures(1, &page->texture);
+	glBindTexture(GL_TEXTURE_2D, page->texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, atlas_min_filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-	// Find a position in the atlas for this texture (with added border)
-	uint32_t grid_width = (bw + ATLAS_GRID - 1) / ATLAS_GRID;
-	uint32_t grid_height = (bh + ATLAS_GRID - 1) / ATLAS_GRID;
-	uint32_t grid_x = 0;
-	uint32_t grid_y = ATLAS_SIZE - grid_height + 1;
+	float anisotropy = 0;
+	glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &anisotropy);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
 
-	for (uint32_t cx = 0; cx < ATLAS_SIZE - grid_width; cx++) {
-		if (atlas_map[cx] >= grid_y) {
-			continue;
-		}
+	uint32_t levels = RENDER_USE_MIPMAPS ? ATLAS_MIP_LEVELS : 1;
+	for (uint32_t level = 0; level < levels; level++) {
+		uint32_t size = ATLAS_SIZE >> level;
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	}
+	stats.texture_binds++;
+	printf("atlas texture %5d (page %d)\n", page->texture, atlas_pages_len);
+
+	atlas_init(&page->atlas, ATLAS_SIZE, ATLAS_SIZE);
+
+	// Build the levels below the cpu side copy once, so that they are not
+	// undefined where no texture is
+	memset(page->mip_pixels, 0, sizeof(page->mip_pixels));
+	page->mip_dirty_len = 0;
+	if (RENDER_USE_MIPMAPS) {
+		render_atlas_mip_mark_dirty(page, (render_mip_rect_t){
+			.min = vec2i(0, 0), 
+			.max = vec2i(ATLAS_MIP_CPU_SIZE, ATLAS_MIP_CPU_SIZE)
+		});
+	}
+	return atlas_pages_len++;
+}
 
-		uint32_t cy = atlas_map[cx];
-		bool is_best = true;
+static inline vec2i_t render_texture_atlas_size(vec2i_t size) {
+	return vec2i(
+		(size.x + ATLAS_BORDER * 2 + ATLAS_GRID - 1) & ~(ATLAS_GRID - 1),
+		(size.y + ATLAS_BORDER * 2 + ATLAS_GRID - 1) & ~(ATLAS_GRID - 1)
+	);
+}
 
-		for (uint32_t bx = cx; bx < cx + grid_width; bx++) {
-			if (atlas_map[bx] >= grid_y) {
-				is_best = false;
-				cx = bx;
-				break;
-			}
-			if (atlas_map[bx] > cy) {
-				cy = atlas_map[bx];
-			}
-		}
-		if (is_best) {
-			grid_y = cy;
-			grid_x = cx;
+// Find a place for the texture (with added border) in the first page that
+// has room for it, or in a new page
+static void render_texture_place(render_texture_t *t) {
+	vec2i_t size = render_texture_atlas_size(t->size);
+	vec2i_t pos;
+	for (t->page = 0; t->page < atlas_pages_len; t->page++) {
+		if (atlas_insert(&atlas_pages[t->page].atlas, size.x, size.y, &pos)) {
+			t->offset = vec2i(pos.x + ATLAS_BORDER, pos.y + ATLAS_BORDER);
+			return;
 		}
 	}
 
-	error_if(grid_y + grid_height > ATLAS_SIZE, "Render atlas ran out of space");
+	t->page = render_atlas_page_add();
+	error_if(
+		!atlas_insert(&atlas_pages[t->page].atlas, size.x, size.y, &pos),
+		"Texture %dx%d doesn't fit into the render atlas", t->size.x, t->size.y
+	);
+	t->offset = vec2i(pos.x + ATLAS_BORDER, pos.y + ATLAS_BORDER);
+}
 
-	for (uint32_t cx = grid_x; cx < grid_x + grid_width; cx++) {
-		atlas_map[cx] = grid_y + grid_height;
-	}
+// Upload the texture with its border, filled up to the ATLAS_GRID aligned
+// size by repeating the edge pixels, and its mip levels
+static void render_texture_upload(render_texture_t *t, rgba_t *pixels) {
+	uint32_t tw = t->size.x;
+	uint32_t th = t->size.y;
+	vec2i_t size = render_texture_atlas_size(t->size);
+	vec2i_t pos = vec2i(t->offset.x - ATLAS_BORDER, t->offset.y - ATLAS_BORDER);
 
-	// Add the border pixels for this texture
-	rgba_t *pb = mem_temp_alloc(sizeof(rgba_t) * bw * bh);
+	rgba_t *pb = mem_temp_alloc(sizeof(rgba_t) * size.x * size.y);
 
 	if (tw && th) {
-		// Top border
-		for (int32_t y = 0; y < ATLAS_BORDER; y++) {
-			memcpy(pb + bw * y + ATLAS_BORDER, pixels, tw * sizeof(rgba_t));
-		}
+		for (int32_t y = 0; y < size.y; y++) {
+			rgba_t *src = pixels + clamp(y - ATLAS_BORDER, 0, th - 1) * tw;
+			rgba_t *dst = pb + y * size.x;
 
-		// Bottom border
-		for (int32_t y = 0; y < ATLAS_BORDER; y++) {
-			memcpy(pb + bw * (bh - ATLAS_BORDER + y) + ATLAS_BORDER, pixels + tw * (th-1), tw * sizeof(rgba_t));
-		}
-		
-		// Left border
-		for (int32_t y = 0; y < bh; y++) {
+			// Left border, texture, right border
 			for (int32_t x = 0; x < ATLAS_BORDER; x++) {
-				pb[y * bw + x] = pixels[clamp(y-ATLAS_BORDER, 0, th-1) * tw];
+				dst[x] = src[0];
 			}
-		}
-
-		// Right border
-		for (int32_t y = 0; y < bh; y++) {
-			for (int32_t x = 0; x < ATLAS_BORDER; x++) {
-				pb[y * bw + x + bw - ATLAS_BORDER] = pixels[tw - 1 + clamp(y-ATLAS_BORDER, 0, th-1) * tw];
+			memcpy(dst + ATLAS_BORDER, src, tw * sizeof(rgba_t));
+			for (int32_t x = ATLAS_BORDER + tw; x < size.x; x++) {
+				dst[x] = src[tw - 1];
 			}
 		}
-
-		// Texture
-		for (int32_t y = 0; y < th; y++) {
-			memcpy(pb + bw * (y + ATLAS_BORDER) + ATLAS_BORDER, pixels + tw * y, tw * sizeof(rgba_t));
-		}
 	}
+	else {
+		memset(pb, 0, sizeof(rgba_t) * size.x * size.y);
+	}
+
+	render_atlas_page_t *page = &atlas_pages[t->page];
+	glBindTexture(GL_TEXTURE_2D, page->texture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, pos.x, pos.y, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, pb);
+	stats.texture_binds++;
+	stats.bytes_uploaded += size.x * size.y * sizeof(rgba_t);
 
-	uint32_t x = grid_x * ATLAS_GRID;
-	uint32_t y = grid_y * ATLAS_GRID;
-	glBindTexture(GL_TEXTURE_2D, atlas_texture);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, bw, bh, GL_RGBA, GL_UNSIGNED_BYTE, pb);
+	if (RENDER_USE_MIPMAPS) {
+		render_atlas_mip_upload(page, pos, size, pb);
+	}
 	mem_temp_free(pb);
+}
 
+uint16_t render_texture_create(uint32_t tw, uint32_t th, rgba_t *pixels) {
+	error_if(textures_len >= TEXTURES_MAX, "TEXTURES_MAX reached");
 
-	texture_mipmap_is_dirty = RENDER_USE_MIPMAPS;
 	uint16_t texture_index = textures_len;
+	render_texture_t *t = &textures[texture_index];
+	t->size = vec2i(tw, th);
+	render_texture_place(t);
+	render_texture_upload(t, pixels);
 	textures_len++;
-	textures[texture_index] = (render_texture_t){ {x + ATLAS_BORDER, y + ATLAS_BORDER}, {tw, th} };
 
-	printf("inserted atlas texture (%3dx%3d) at (%3d,%3d)\n", tw, th, grid_x, grid_y);
+	printf("inserted atlas texture (%3dx%3d) at (%4d,%4d) page %d\n", tw, th, t->offset.x, t->offset.y, t->page);
 	return texture_index;
 }
 
+typedef struct {
+	uint16_t index;
+	vec2i_t size;
+} render_texture_order_t;
+
+static inline bool render_texture_order_compare(render_texture_order_t *a, render_texture_order_t *b) {
+	// Returns true if a should be placed after b
+	if (a->size.y != b->size.y) {
+		return a->size.y < b->size.y;
+	}
+	return a->size.x < b->size.x;
+}
+
+void render_textures_create(uint32_t len, vec2i_t *sizes, rgba_t **pixels) {
+	error_if(textures_len + len > TEXTURES_MAX, "TEXTURES_MAX reached");
+
+	// Place the textures tallest first; this leaves less space below the
+	// skyline than placing them in the order they come in.
+	render_texture_order_t *order = mem_temp_alloc(sizeof(render_texture_order_t) * len);
+	for (uint32_t i = 0; i < len; i++) {
+		order[i] = (render_texture_order_t){.index = i, .size = sizes[i]};
+	}
+	sort(order, len, render_texture_order_compare);
+
+	for (uint32_t i = 0; i < len; i++) {
+		render_texture_t *t = &textures[textures_len + order[i].index];
+		t->size = order[i].size;
+		render_texture_place(t);
+	}
+	mem_temp_free(order);
+
+	for (uint32_t i = 0; i < len; i++) {
+		render_texture_upload(&textures[textures_len + i], pixels[i]);
+	}
+	textures_len += len;
+	printf("inserted %d atlas textures\n", len);
+}
+
 vec2i_t render_texture_size(uint16_t texture_index) {
 	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
 	return textures[texture_index].size;
@@ -956,10 +1659,11 @@ vec2i_t render_texture_size(uint16_t texture_index) {
 
 void render_texture_replace_pixels(int16_t texture_index, rgba_t *pixels) {
 	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+	render_flush();
 
-	render_texture_t *t = &textures[texture_index];
-	glBindTexture(GL_TEXTURE_2D, atlas_texture);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, t->offset.x, t->offset.y, t->size.x, t->size.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	// Upload with the border, so that the mip levels of just this texture
+	// can be rebuilt
+	render_texture_upload(&textures[texture_index], pixels);
 }
 
 uint16_t render_textures_len() {
@@ -970,8 +1674,11 @@ void render_textures_reset(uint16_t len) {
 	error_if(len > textures_len, "Invalid texture reset len %d >= %d", len, textures_len);
 	render_flush();
 
+	// Pages keep their gl texture and are filled again from the top
 	textures_len = len;
-	clear(atlas_map);
+	for (int i = 0; i < atlas_pages_len; i++) {
+		atlas_init(&atlas_pages[i].atlas, ATLAS_SIZE, ATLAS_SIZE);
+	}
 
 	// Clear completely and recreate the default white texture
 	if (len == 0) {
@@ -983,23 +1690,216 @@ void render_textures_reset(uint16_t len) {
 		return;
 	}
 
-	// Replay all texture grid insertions up to the reset len
+	// Place all textures up to the reset len again
 	for (int i = 0; i < textures_len; i++) {
-		uint32_t grid_x = (textures[i].offset.x - ATLAS_BORDER) / ATLAS_GRID;
-		uint32_t grid_y = (textures[i].offset.y - ATLAS_BORDER) / ATLAS_GRID;
-		uint32_t grid_width = (textures[i].size.x + ATLAS_BORDER * 2 + ATLAS_GRID - 1) / ATLAS_GRID;
-		uint32_t grid_height = (textures[i].size.y + ATLAS_BORDER * 2 + ATLAS_GRID - 1) / ATLAS_GRID;
-		for (uint32_t cx = grid_x; cx < grid_x + grid_width; cx++) {
-			atlas_map[cx] = grid_y + grid_height;
-		}
+		vec2i_t size = render_texture_atlas_size(textures[i].size);
+		vec2i_t pos = vec2i(textures[i].offset.x - ATLAS_BORDER, textures[i].offset.y - ATLAS_BORDER);
+		atlas_place(&atlas_pages[textures[i].page].atlas, pos, size.x, size.y);
 	}
 }
 
 void render_textures_dump(const char *path) {
-	int width = ATLAS_SIZE * ATLAS_GRID;
-	int height = ATLAS_SIZE * ATLAS_GRID;
+	// All pages below each other
+	int width = ATLAS_SIZE;
+	int height = ATLAS_SIZE * atlas_pages_len;
 	rgba_t *pixels = malloc(sizeof(rgba_t) * width * height);
-	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	for (int i = 0; i < atlas_pages_len; i++) {
+		glBindTexture(GL_TEXTURE_2D, atlas_pages[i].texture);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels + i * ATLAS_SIZE * ATLAS_SIZE);
+	}
 	stbi_write_png(path, width, height, 4, pixels, 0);
 	free(pixels);
 }
+
+
+
+// -----------------------------------------------------------------------------
+// Static meshes
+
+// Each mesh has its own vertex and index buffer. The uv of all vertices is
+// offset into the atlas at upload time. The two tris of a quad usually share
+// two vertices; these are only stored once. A draw of a mesh with textures
+// on different atlas pages is split into one packet for each run of tris on
+// the same page.
+
+static inline vertex_t render_mesh_vertex(render_mesh_t *m, uint32_t tris_index, uint32_t vertex_index) {
+	render_texture_t *t = &textures[m->textures[tris_index]];
+	vertex_t v = m->tris[tris_index].vertices[vertex_index];
+	v.uv.x += t->offset.x;
+	v.uv.y += t->offset.y;
+	return v;
+}
+
+// Update the page of the tris in the given range, and the page of the mesh
+// if any changed
+static void render_mesh_update_pages(render_mesh_t *m, uint32_t start, uint32_t end) {
+	bool changed = false;
+	for (uint32_t i = start; i < end; i++) {
+		uint8_t page = textures[m->textures[i]].page;
+		changed |= (m->pages[i] != page);
+		m->pages[i] = page;
+	}
+	if (!changed) {
+		return;
+	}
+
+	m->page = m->len ? m->pages[0] : 0;
+	for (uint32_t i = 1; i < m->len; i++) {
+		if (m->pages[i] != m->page) {
+			m->page = RENDER_MESH_PAGES_MIXED;
+			break;
+		}
+	}
+}
+
+static inline bool render_mesh_vertex_equals(vertex_t *a, vertex_t *b) {
+	return 
+		a->pos.x == b->pos.x && a->pos.y == b->pos.y && a->pos.z == b->pos.z &&
+		a->uv.x == b->uv.x && a->uv.y == b->uv.y &&
+		a->color.as_uint32 == b->color.as_uint32;
+}
+
+uint16_t render_mesh_create(tris_t *tris, uint16_t *textures_for_tris, uint32_t len, uint32_t quads_len) {
+	error_if(meshes_len >= MESHES_MAX, "MESHES_MAX reached");
+
+	uint16_t mesh_index = meshes_len;
+	render_mesh_t *m = &meshes[mesh_index];
+	m->tris = tris;
+	m->textures = textures_for_tris;
+	m->len = len;
+	m->quads_len = quads_len;
+	m->indices = mem_bump(sizeof(uint16_t) * len * 3);
+	m->pages = mem_bump(sizeof(uint8_t) * len);
+
+	vertex_t *vertices = mem_temp_alloc(sizeof(vertex_t) * len * 3);
+	uint32_t vertices_len = 0;
+
+	for (uint32_t i = 0; i < len; i++) {
+		error_if(textures_for_tris[i] >= textures_len, "Invalid texture %d", textures_for_tris[i]);
+		bool is_second_of_pair = i < quads_len * 2 && (i & 1);
+
+		for (uint32_t vi = 0; vi < 3; vi++) {
+			vertex_t v = render_mesh_vertex(m, i, vi);
+			int32_t index = -1;
+			
+			if (is_second_of_pair) {
+				for (uint32_t pi = 0; pi < 3; pi++) {
+					uint16_t prev_index = m->indices[(i - 1) * 3 + pi];
+					if (render_mesh_vertex_equals(&vertices[prev_index], &v)) {
+						index = prev_index;
+						break;
+					}
+				}
+			}
+
+			if (index == -1) {
+				error_if(vertices_len > 0xffff, "Mesh exceeds 65536 vertices");
+				index = vertices_len++;
+				vertices[index] = v;
+			}
+			m->indices[i * 3 + vi] = index;
+		}
+	}
+
+	m->page = 0;
+	memset(m->pages, 0xff, sizeof(uint8_t) * len);
+	render_mesh_update_pages(m, 0, len);
+
+	glGenBuffers(1, &m->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m->vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_t) * vertices_len, vertices, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m->ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * len * 3, m->indices, GL_STATIC_DRAW);
+	stats.bytes_uploaded += sizeof(vertex_t) * vertices_len + sizeof(uint16_t) * len * 3;
+
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	mem_temp_free(vertices);
+
+	meshes_len++;
+	return mesh_index;
+}
+
+void render_mesh_update(uint16_t mesh_index, uint32_t offset, uint32_t len) {
+	error_if(mesh_index >= meshes_len, "Invalid mesh %d", mesh_index);
+	render_mesh_t *m = &meshes[mesh_index];
+	error_if(offset + len > m->len, "Invalid mesh update range %d, %d", offset, len);
+
+	// Draws of this mesh that are still pending must see the old data
+	if (render_packets_use_mesh(mesh_index)) {
+		render_flush();
+	}
+
+	// Extend the range to whole quads, so that all vertices between the lowest 
+	// and highest index are written.
+	uint32_t start = offset < m->quads_len * 2 ? offset & ~1 : offset;
+	uint32_t end = offset + len < m->quads_len * 2 ? (offset + len + 1) & ~1 : offset + len;
+	if (start >= end) {
+		return;
+	}
+	render_mesh_update_pages(m, start, end);
+
+	uint32_t index_min = 0xffff;
+	uint32_t index_max = 0;
+	for (uint32_t i = start * 3; i < end * 3; i++) {
+		index_min = min(index_min, m->indices[i]);
+		index_max = max(index_max, m->indices[i]);
+	}
+
+	vertex_t *vertices = mem_temp_alloc(sizeof(vertex_t) * (index_max - index_min + 1));
+	for (uint32_t i = start; i < end; i++) {
+		for (uint32_t vi = 0; vi < 3; vi++) {
+			vertices[m->indices[i * 3 + vi] - index_min] = render_mesh_vertex(m, i, vi);
+		}
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, m->vbo);
+	glBufferSubData(
+		GL_ARRAY_BUFFER, sizeof(vertex_t) * index_min, 
+		sizeof(vertex_t) * (index_max - index_min + 1), vertices
+	);
+	stats.bytes_uploaded += sizeof(vertex_t) * (index_max - index_min + 1);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	mem_temp_free(vertices);
+}
+
+void render_mesh_draw(uint16_t mesh_index, uint32_t offset, uint32_t len) {
+	error_if(mesh_index >= meshes_len, "Invalid mesh %d", mesh_index);
+	render_mesh_t *m = &meshes[mesh_index];
+	error_if(offset + len > m->len, "Invalid mesh draw range %d, %d", offset, len);
+	if (len == 0) {
+		return;
+	}
+
+	if (m->page != RENDER_MESH_PAGES_MIXED) {
+		render_packets_reserve();
+		render_packets_push(mesh_index, m->page, offset, len);
+		return;
+	}
+
+	for (uint32_t start = offset, end = offset + len; start < end;) {
+		uint32_t run_end = start + 1;
+		while (run_end < end && m->pages[run_end] == m->pages[start]) {
+			run_end++;
+		}
+		render_packets_reserve();
+		render_packets_push(mesh_index, m->pages[start], start, run_end - start);
+		start = run_end;
+	}
+}
+
+uint16_t render_meshes_len() {
+	return meshes_len;
+}
+
+void render_meshes_reset(uint16_t len) {
+	error_if(len > meshes_len, "Invalid mesh reset len %d >= %d", len, meshes_len);
+	render_flush();
+
+	for (int i = len; i < meshes_len; i++) {
+		glDeleteBuffers(1, &meshes[i].vbo);
+		glDeleteBuffers(1, &meshes[i].ibo);
+	}
+	meshes_len = len;
+}
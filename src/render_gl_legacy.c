@@ -37,6 +37,7 @@
 #include "render.h"
 #include "mem.h"
 #include "utils.h"
+#include "profiler.h"
 
 #undef RENDER_USE_MIPMAPS
 #define RENDER_USE_MIPMAPS 0
@@ -73,6 +74,9 @@ static render_texture_t textures[TEXTURES_MAX];
 static uint32_t textures_len = 0;
 static uint16_t texture_index_prev = (uint16_t)0;
 
+static render_stats_t stats = {0};
+static render_stats_t stats_last_frame = {0};
+
 static void render_flush();
 void render_textures_dump(const char *path);
 void render_texture_dump(unsigned int textureNum);
@@ -205,6 +209,7 @@ void render_frame_prepare() {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glEnable(GL_TEXTURE_2D);
 	glBindTexture(GL_TEXTURE_2D, textures[RENDER_NO_TEXTURE].texId);
+	stats.texture_binds++;
 }
 
 void render_frame_end() {
@@ -215,6 +220,14 @@ void render_frame_end() {
 		glKosSwapBuffers();
 	#endif
 	screen_2d_z = -1;
+
+	stats.textures_len = textures_len;
+	stats_last_frame = stats;
+	stats = (render_stats_t){0};
+}
+
+render_stats_t render_get_stats() {
+	return stats_last_frame;
 }
 
 void render_flush() {
@@ -222,6 +235,8 @@ void render_flush() {
 		return;
 	}
 
+	profiler_begin(PROFILER_ZONE_RENDER_FLUSH);
+
 	// Send all tris
 	render_texture_t *t = &textures[texture_index_prev];
 	glBindTexture(GL_TEXTURE_2D, t->texId);
@@ -229,7 +244,14 @@ void render_flush() {
   glTexCoordPointer(2, GL_FLOAT, sizeof(vertex_t), &tris_buffer[0].vertices[0].uv);
   glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(vertex_t), &tris_buffer[0].vertices[0].color);
   glDrawArrays(GL_TRIANGLES, 0, tris_len * 3);
+
+	stats.flushes++;
+	stats.draw_calls++;
+	stats.texture_binds++;
+	stats.tris += tris_len;
+	stats.bytes_uploaded += sizeof(tris_t) * tris_len;
 	tris_len = 0;
+	profiler_end(PROFILER_ZONE_RENDER_FLUSH);
 }
 
 
@@ -250,6 +272,7 @@ void render_set_view(vec3_t pos, vec3_t angles) {
 	glLoadMatrixf(projection_mat_3d.m);
   glMatrixMode(GL_MODELVIEW);
 	glLoadMatrixf(view_mat.m);
+	stats.state_changes += 2;
 	//glUniform2f(u_fade, RENDER_FADEOUT_NEAR, RENDER_FADEOUT_FAR);
 }
 
@@ -264,6 +287,7 @@ void render_set_view_2d() {
 	glLoadMatrixf(projection_mat_2d.m);
   glMatrixMode(GL_MODELVIEW);
 	glLoadMatrixf(mat4_identity().m);
+	stats.state_changes += 2;
 }
 
 void render_set_model_mat(mat4_t *m) {
@@ -273,20 +297,24 @@ void render_set_model_mat(mat4_t *m) {
 void render_push_matrix() {
 	glPushMatrix();
 	glMultMatrixf(model_mat.m);
+	stats.state_changes++;
 }
 
 void render_pop_matrix() {
 	render_flush();
 	glPopMatrix();
+	stats.state_changes++;
 }
 
 void render_set_depth_write(bool enabled) {
 	render_flush();
+	stats.state_changes++;
 	glDepthMask(enabled);
 }
 
 void render_set_depth_test(bool enabled) {
 	render_flush();
+	stats.state_changes++;
 	if (enabled) {
 		glEnable(GL_DEPTH_TEST);
 	}
@@ -297,6 +325,7 @@ void render_set_depth_test(bool enabled) {
 
 void render_set_depth_offset(float offset) {
 	render_flush();
+	stats.state_changes++;
 	if (offset == 0) {
 		glDisable(GL_POLYGON_OFFSET_FILL);
 		return;
@@ -324,6 +353,7 @@ void render_set_blend_mode(render_blend_mode_t new_mode) {
 		return;
 	}
 	render_flush();
+	stats.state_changes++;
 
 	blend_mode = new_mode;
 	if (blend_mode == RENDER_BLEND_NORMAL) {
@@ -336,6 +366,7 @@ void render_set_blend_mode(render_blend_mode_t new_mode) {
 
 void render_set_cull_backface(bool enabled) {
 	render_flush();
+	stats.state_changes++;
 	if (enabled) {
 		glEnable(GL_CULL_FACE);
 	}
@@ -348,6 +379,12 @@ vec3_t render_transform(vec3_t pos) {
 	return vec3_transform(vec3_transform(pos, &view_mat), &projection_mat_3d);
 }
 
+frustum_t render_frustum() {
+	mat4_t view_projection;
+	mat4_mul(&view_projection, &projection_mat_3d, &view_mat);
+	return frustum_from_mat4(&view_projection);
+}
+
 void render_push_tris(tris_t tris, uint16_t texture_index) {
 	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
 
@@ -546,6 +583,8 @@ uint16_t render_texture_create(uint32_t tw, uint32_t th, rgba_t *pixels) {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex_width, tex_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, _pixels);
+	stats.texture_binds++;
+	stats.bytes_uploaded += tex_width * tex_height * sizeof(rgba_t);
 
 	if(pb){
 		mem_temp_free(pb);
@@ -561,6 +600,12 @@ uint16_t render_texture_create(uint32_t tw, uint32_t th, rgba_t *pixels) {
 	return texture_index;
 }
 
+void render_textures_create(uint32_t len, vec2i_t *sizes, rgba_t **pixels) {
+	for (uint32_t i = 0; i < len; i++) {
+		render_texture_create(sizes[i].x, sizes[i].y, pixels[i]);
+	}
+}
+
 vec2i_t render_texture_size(uint16_t texture_index) {
 	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
 	return textures[texture_index].size;
@@ -573,6 +618,8 @@ void render_texture_replace_pixels(int16_t texture_index, rgba_t *pixels) {
 	render_texture_t *t = &textures[texture_index];
   glBindTexture(GL_TEXTURE_2D, t->texId);
   glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, t->size.x, t->size.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	stats.texture_binds++;
+	stats.bytes_uploaded += t->size.x * t->size.y * sizeof(rgba_t);
 }
 
 uint16_t render_textures_len() {
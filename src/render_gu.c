@@ -9,6 +9,7 @@
 #include "render.h"
 #include "mem.h"
 #include "utils.h"
+#include "profiler.h"
 
 #include <pspkernel.h>
 #include <pspdebug.h>
@@ -59,6 +60,9 @@ static render_texture_t textures[TEXTURES_MAX];
 static uint32_t textures_len = 0;
 static uint16_t texture_index_prev = (uint16_t)0;
 
+static render_stats_t stats = {0};
+static render_stats_t stats_last_frame = {0};
+
 Texman_State ramTexman;
 Texman_State vramTexman;
 
@@ -267,6 +271,15 @@ void render_frame_end()
 	sceGuSync(0, 0);
 	sceDisplayWaitVblankStart();
 	sceGuSwapBuffers();
+
+	stats.textures_len = textures_len;
+	stats_last_frame = stats;
+	stats = (render_stats_t){0};
+}
+
+render_stats_t render_get_stats()
+{
+	return stats_last_frame;
 }
 
 void render_flush()
@@ -276,6 +289,8 @@ void render_flush()
 		return;
 	}
 
+	profiler_begin(PROFILER_ZONE_RENDER_FLUSH);
+
 	// Send all tris
 	render_texture_t *t = &textures[texture_index_prev];
 	texman_bind_tex(&vramTexman, t->texId);
@@ -284,7 +299,13 @@ void render_flush()
 	memcpy(buf, tris_buffer, sizeof(tris_t) * tris_len);
 	sceGuDrawArray(GU_TRIANGLES, GU_TEXTURE_32BITF | GU_COLOR_8888 | GU_VERTEX_32BITF | GU_TRANSFORM_3D, 3 * tris_len, 0, buf);
 
+	stats.flushes++;
+	stats.draw_calls++;
+	stats.texture_binds++;
+	stats.tris += tris_len;
+	stats.bytes_uploaded += sizeof(tris_t) * tris_len;
 	tris_len = 0;
+	profiler_end(PROFILER_ZONE_RENDER_FLUSH);
 }
 
 void render_set_view(vec3_t pos, vec3_t angles)
@@ -307,6 +328,7 @@ void render_set_view(vec3_t pos, vec3_t angles)
 	void *matrix_inline_view = (void *)ALIGN((unsigned int)sceGuGetMemory(sizeof(mat4_t) + 15), 16);
 	memcpy(matrix_inline_view, view_mat.m, sizeof(mat4_t));
 	sceGuSetMatrix(GU_VIEW, (const ScePspFMatrix4 *)matrix_inline_view);
+	stats.state_changes += 2;
 
 	// glUniform2f(u_fade, RENDER_FADEOUT_NEAR, RENDER_FADEOUT_FAR);
 }
@@ -322,6 +344,7 @@ void render_set_view_2d()
 	sceGuSetMatrix(GU_PROJECTION, (const ScePspFMatrix4 *)projection_mat_2d.m);
 	sceGuSetMatrix(GU_VIEW, (const ScePspFMatrix4 *)identity_matrix.m);
 	sceGuSetMatrix(GU_MODEL, (const ScePspFMatrix4 *)identity_matrix.m);
+	stats.state_changes += 3;
 }
 
 void render_set_model_mat(mat4_t *m)
@@ -335,23 +358,27 @@ void render_push_matrix()
 	void *matrix_inline_model = (void *)ALIGN((unsigned int)sceGuGetMemory(sizeof(mat4_t) + 15), 16);
 	memcpy(matrix_inline_model, model_mat.m, sizeof(mat4_t));
 	sceGuSetMatrix(GU_MODEL, (const ScePspFMatrix4 *)matrix_inline_model);
+	stats.state_changes++;
 }
 void render_pop_matrix()
 {
 	render_flush();
 
 	sceGuSetMatrix(GU_MODEL, (const ScePspFMatrix4 *)identity_matrix.m);
+	stats.state_changes++;
 }
 
 void render_set_depth_write(bool enabled)
 {
 	render_flush();
+	stats.state_changes++;
 	sceGuDepthMask(enabled ? GU_FALSE : GU_TRUE);
 }
 
 void render_set_depth_test(bool enabled)
 {
 	render_flush();
+	stats.state_changes++;
 	if (enabled)
 	{
 		sceGuEnable(GU_DEPTH_TEST);
@@ -365,6 +392,7 @@ void render_set_depth_test(bool enabled)
 void render_set_depth_offset(float offset)
 {
 	render_flush();
+	stats.state_changes++;
 	if (offset == 0)
 	{
 		sceGuDepthOffset(0);
@@ -387,6 +415,7 @@ void render_set_blend_mode(render_blend_mode_t new_mode)
 		return;
 	}
 	render_flush();
+	stats.state_changes++;
 
 	blend_mode = new_mode;
 	if (blend_mode == RENDER_BLEND_NORMAL)
@@ -402,6 +431,7 @@ void render_set_blend_mode(render_blend_mode_t new_mode)
 void render_set_cull_backface(bool enabled)
 {
 	render_flush();
+	stats.state_changes++;
 	if (enabled)
 	{
 		sceGuEnable(GU_CULL_FACE);
@@ -417,6 +447,13 @@ vec3_t render_transform(vec3_t pos)
 	return vec3_transform(vec3_transform(pos, &view_mat), &projection_mat_3d);
 }
 
+frustum_t render_frustum()
+{
+	mat4_t view_projection;
+	mat4_mul(&view_projection, &projection_mat_3d, &view_mat);
+	return frustum_from_mat4(&view_projection);
+}
+
 void render_push_tris(tris_t tris, uint16_t texture_index)
 {
 	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
@@ -601,6 +638,7 @@ uint16_t render_texture_create(uint32_t tw, uint32_t th, rgba_t *pixels)
 
 	sceGuTexFilter(GU_NEAREST, GU_LINEAR);
 	sceGuTexWrap(GU_CLAMP, GU_CLAMP);
+	stats.bytes_uploaded += tex_width * th * sizeof(rgba_t);
 
 	if (pb)
 	{
@@ -623,6 +661,14 @@ uint16_t render_texture_create(uint32_t tw, uint32_t th, rgba_t *pixels)
 	return texture_index;
 }
 
+void render_textures_create(uint32_t len, vec2i_t *sizes, rgba_t **pixels)
+{
+	for (uint32_t i = 0; i < len; i++)
+	{
+		render_texture_create(sizes[i].x, sizes[i].y, pixels[i]);
+	}
+}
+
 vec2i_t render_texture_size(uint16_t texture_index)
 {
 	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
@@ -0,0 +1,44 @@
+#include "render.h"
+#include "utils.h"
+
+#define MESHES_MAX 2048
+
+typedef struct {
+	tris_t *tris;
+	uint16_t *textures;
+	uint32_t len;
+} render_mesh_t;
+
+static render_mesh_t meshes[MESHES_MAX];
+static uint32_t meshes_len = 0;
+
+uint16_t render_mesh_create(tris_t *tris, uint16_t *textures_for_tris, uint32_t len, uint32_t quads_len) {
+	error_if(meshes_len >= MESHES_MAX, "MESHES_MAX reached");
+	uint16_t mesh_index = meshes_len;
+	meshes[mesh_index] = (render_mesh_t){tris, textures_for_tris, len};
+	meshes_len++;
+	return mesh_index;
+}
+
+void render_mesh_update(uint16_t mesh_index, uint32_t offset, uint32_t len) {
+	error_if(mesh_index >= meshes_len, "Invalid mesh %d", mesh_index);
+}
+
+void render_mesh_draw(uint16_t mesh_index, uint32_t offset, uint32_t len) {
+	error_if(mesh_index >= meshes_len, "Invalid mesh %d", mesh_index);
+	render_mesh_t *m = &meshes[mesh_index];
+	error_if(offset + len > m->len, "Invalid mesh draw range %d, %d", offset, len);
+
+	for (uint32_t i = offset; i < offset + len; i++) {
+		render_push_tris(m->tris[i], m->textures[i]);
+	}
+}
+
+uint16_t render_meshes_len() {
+	return meshes_len;
+}
+
+void render_meshes_reset(uint16_t len) {
+	error_if(len > meshes_len, "Invalid mesh reset len %d >= %d", len, meshes_len);
+	meshes_len = len;
+}
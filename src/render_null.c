@@ -0,0 +1,178 @@
+#include "system.h"
+#include "render.h"
+#include "mem.h"
+#include "utils.h"
+
+// A renderer that draws nothing. It keeps track of the view and projection
+// so that render_transform() still returns sensible values for the game code,
+// but otherwise just accepts all geometry. Used for headless benchmark runs.
+
+#define NEAR_PLANE 16.0
+#define FAR_PLANE (RENDER_FADEOUT_FAR)
+#define TEXTURES_MAX 1024
+
+
+static vec2i_t screen_size;
+
+static mat4_t view_mat = mat4_identity();
+static mat4_t projection_mat = mat4_identity();
+
+static vec2i_t textures[TEXTURES_MAX];
+static uint32_t textures_len;
+
+// Nothing is drawn here, but the stats count draw calls as a renderer that
+// batches until the next state or texture change would. This makes them
+// usable to compare batching behavior on headless runs.
+static render_stats_t stats = {0};
+static render_stats_t stats_last_frame = {0};
+static bool batch_is_open = false;
+static uint16_t batch_texture = 0;
+
+uint16_t RENDER_NO_TEXTURE;
+
+
+void render_init(vec2i_t screen_size) {
+	render_set_screen_size(screen_size);
+	textures_len = 0;
+
+	rgba_t white_pixels[4] = {
+		rgba(128,128,128,255), rgba(128,128,128,255),
+		rgba(128,128,128,255), rgba(128,128,128,255)
+	};
+	RENDER_NO_TEXTURE = render_texture_create(2, 2, white_pixels);
+}
+
+void render_cleanup() {}
+
+void render_set_screen_size(vec2i_t size) {
+	screen_size = size;
+
+	float aspect = (float)size.x / (float)size.y;
+	float fov = (73.75 / 180.0) * 3.14159265358;
+	float f = 1.0 / tan(fov / 2);
+	float nf = 1.0 / (NEAR_PLANE - FAR_PLANE);
+	projection_mat = mat4(
+		f / aspect, 0, 0, 0,
+		0, f, 0, 0,
+		0, 0, (FAR_PLANE + NEAR_PLANE) * nf, -1,
+		0, 0, 2 * FAR_PLANE * NEAR_PLANE * nf, 0
+	);
+}
+
+void render_set_resolution(render_resolution_t res) {}
+void render_set_post_effect(render_post_effect_t post) {}
+
+vec2i_t render_size() {
+	return screen_size;
+}
+
+
+void render_frame_prepare() {}
+
+void render_frame_end() {
+	batch_is_open = false;
+	stats.textures_len = textures_len;
+	stats_last_frame = stats;
+	stats = (render_stats_t){0};
+}
+
+render_stats_t render_get_stats() {
+	return stats_last_frame;
+}
+
+static void render_state_change() {
+	batch_is_open = false;
+	stats.state_changes++;
+}
+
+void render_set_view(vec3_t pos, vec3_t angles) {
+	view_mat = mat4_identity();
+	mat4_set_translation(&view_mat, vec3(0, 0, 0));
+	mat4_set_roll_pitch_yaw(&view_mat, vec3(angles.x, -angles.y + M_PI, angles.z + M_PI));
+	mat4_translate(&view_mat, vec3_inv(pos));
+	render_state_change();
+}
+
+void render_set_view_2d() { render_state_change(); }
+void render_set_model_mat(mat4_t *m) { render_state_change(); }
+void render_set_depth_write(bool enabled) { render_state_change(); }
+void render_set_depth_test(bool enabled) { render_state_change(); }
+void render_set_depth_offset(float offset) { render_state_change(); }
+void render_set_screen_position(vec2_t pos) { render_state_change(); }
+void render_set_blend_mode(render_blend_mode_t mode) { render_state_change(); }
+void render_set_cull_backface(bool enabled) { render_state_change(); }
+void render_push_matrix() {}
+void render_pop_matrix() {}
+
+vec3_t render_transform(vec3_t pos) {
+	return vec3_transform(vec3_transform(pos, &view_mat), &projection_mat);
+}
+
+frustum_t render_frustum() {
+	mat4_t view_projection;
+	mat4_mul(&view_projection, &projection_mat, &view_mat);
+	return frustum_from_mat4(&view_projection);
+}
+
+void render_push_tris(tris_t tris, uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+
+	if (!batch_is_open || texture_index != batch_texture) {
+		stats.flushes++;
+		stats.draw_calls++;
+		stats.texture_binds++;
+		batch_is_open = true;
+		batch_texture = texture_index;
+	}
+	stats.tris++;
+	stats.bytes_uploaded += sizeof(tris_t);
+}
+
+void render_push_sprite(vec3_t pos, vec2i_t size, rgba_t color, uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+}
+
+void render_push_2d(vec2i_t pos, vec2i_t size, rgba_t color, uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+}
+
+void render_push_2d_tile(vec2i_t pos, vec2i_t uv_offset, vec2i_t uv_size, vec2i_t size, rgba_t color, uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+}
+
+
+uint16_t render_texture_create(uint32_t width, uint32_t height, rgba_t *pixels) {
+	error_if(textures_len >= TEXTURES_MAX, "TEXTURES_MAX reached");
+
+	uint16_t texture_index = textures_len;
+	textures[texture_index] = vec2i(width, height);
+	textures_len++;
+	stats.bytes_uploaded += width * height * sizeof(rgba_t);
+	return texture_index;
+}
+
+void render_textures_create(uint32_t len, vec2i_t *sizes, rgba_t **pixels) {
+	for (uint32_t i = 0; i < len; i++) {
+		render_texture_create(sizes[i].x, sizes[i].y, pixels[i]);
+	}
+}
+
+vec2i_t render_texture_size(uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+	return textures[texture_index];
+}
+
+void render_texture_replace_pixels(int16_t texture_index, rgba_t *pixels) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+}
+
+uint16_t render_textures_len() {
+	return textures_len;
+}
+
+void render_textures_reset(uint16_t len) {
+	error_if(len > textures_len, "Invalid texture reset len %d >= %d", len, textures_len);
+	textures_len = len;
+}
+
+void render_textures_dump(const char *path) {}
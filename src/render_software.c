@@ -1,40 +1,176 @@
+#include <string.h>
+
 #include "system.h"
 #include "render.h"
 #include "mem.h"
 #include "utils.h"
 #include "platform.h"
+#include "profiler.h"
+#include "jobs.h"
 
 #define NEAR_PLANE 16.0
 #define FAR_PLANE (RENDER_FADEOUT_FAR)
 #define TEXTURES_MAX 1024
+#define TEXTURE_PIXELS_MAX (2048 * 2048)
+
+// Tris are transformed, clipped and set up in render_push_tris() and then
+// binned into the screen tiles they cover. The tiles are rasterized in
+// parallel on the job threads when the frame ends or the bins are full. Each
+// tile draws its tris in the order they were pushed, so the result is the
+// same as drawing everything in order on one thread.
+
+#define RENDER_TILE_SIZE 64
+#define RENDER_TILES_MAX 4096
+#define RENDER_SCREEN_SIZE_MAX 8192
+#define RENDER_BIN_TRIS_MAX (1 << 16)
+#define RENDER_BIN_CHUNK_LEN 62
+#define RENDER_BIN_CHUNKS_MAX 8192
+
+// Tris are clipped against the near plane and a guard band around the screen,
+// so that screen coordinates stay in a range where the fixed point edge
+// functions can't overflow. Screen coordinates have 4 bits of sub pixel
+// precision.
+#define RENDER_GUARD_BAND 2.0
+#define RENDER_CLIP_VERTICES_MAX 9
+#define RENDER_SUBPIXEL_BITS 4
+#define RENDER_SUBPIXEL_SCALE (1 << RENDER_SUBPIXEL_BITS)
+
+// Each tile keeps the farthest depth of the whole tile and of each 8x8 block
+// of pixels in it. Tris and blocks that are entirely behind those are
+// skipped before any pixel is touched. The farthest depth of a block is only
+// recomputed when it's needed and the block was written to since.
+#ifndef RENDER_USE_HIZ
+	#define RENDER_USE_HIZ 1
+#endif
+#define RENDER_HIZ_BLOCK_SIZE 8
+#define RENDER_HIZ_BLOCKS_PER_ROW (RENDER_TILE_SIZE / RENDER_HIZ_BLOCK_SIZE)
+#define RENDER_HIZ_BLOCKS (RENDER_HIZ_BLOCKS_PER_ROW * RENDER_HIZ_BLOCKS_PER_ROW)
+#define RENDER_HIZ_EPSILON 4e-6f // margin for rounding of the interpolated depth
+
+typedef enum {
+	CLIP_NEAR   = (1<<0),
+	CLIP_LEFT   = (1<<1),
+	CLIP_RIGHT  = (1<<2),
+	CLIP_BOTTOM = (1<<3),
+	CLIP_TOP    = (1<<4),
+	CLIP_PLANES = 5
+} clip_code_t;
+
+typedef struct {
+	float x, y, z, w;
+	float u, v;
+	float r, g, b, a;
+} clip_vertex_t;
+
+typedef enum {
+	RASTER_Z,
+	RASTER_INV_W,
+	RASTER_U,
+	RASTER_V,
+	RASTER_R,
+	RASTER_G,
+	RASTER_B,
+	RASTER_A,
+	RASTER_ATTRIBUTES
+} raster_attribute_t;
 
+typedef struct {
+	render_blend_mode_t blend_mode;
+	bool depth_write;
+	bool depth_test;
+	bool cull_backface;
+	float depth_offset;
+} render_state_t;
+
+// A tris ready for rasterization. Attributes other than z are divided by w
+// and interpolated linearly in screen space: value = base + dx * x + dy * y,
+// relative to the first vertex.
+typedef struct {
+	int32_t x[3], y[3];
+	float origin_x, origin_y;
+	float base[RASTER_ATTRIBUTES];
+	float dx[RASTER_ATTRIBUTES];
+	float dy[RASTER_ATTRIBUTES];
+	int32_t min_x, min_y, max_x, max_y;
+	float min_z;
+	uint16_t texture;
+	render_state_t state;
+} raster_tris_t;
+
+typedef struct {
+	uint32_t tris[RENDER_BIN_CHUNK_LEN];
+	uint32_t len;
+	int32_t next;
+} render_bin_chunk_t;
+
+typedef struct {
+	int32_t first_chunk;
+	int32_t last_chunk;
+	float depth_max;
+	float depth_max_blocks[RENDER_HIZ_BLOCKS];
+	uint64_t depth_dirty_blocks;
+	uint32_t hiz_hits;
+	uint32_t hiz_misses;
+} render_tile_t;
 
 typedef struct {
 	vec2i_t size;
-	rgba_t *pixels;
+	uint32_t offset;
 } render_texture_t;
 
-static void line(vec2i_t p0, vec2i_t p1, rgba_t color);
-
 static rgba_t *screen_buffer;
 static int32_t screen_pitch;
 static int32_t screen_ppr;
 static vec2i_t screen_size;
 
 static mat4_t view_mat = mat4_identity();
+static mat4_t mv_mat = mat4_identity();
 static mat4_t mvp_mat = mat4_identity();
 static mat4_t projection_mat = mat4_identity();
+static mat4_t projection_mat_2d = mat4_identity();
 static mat4_t sprite_mat = mat4_identity();
+static bool view_is_2d = false;
+static vec2_t screen_position = vec2(0, 0);
+
+static render_state_t state = {
+	.blend_mode = RENDER_BLEND_NORMAL,
+	.depth_write = true,
+	.depth_test = true,
+	.cull_backface = true,
+	.depth_offset = 0
+};
+
+static raster_tris_t bin_tris[RENDER_BIN_TRIS_MAX];
+static uint32_t bin_tris_len = 0;
+static render_bin_chunk_t bin_chunks[RENDER_BIN_CHUNKS_MAX];
+static uint32_t bin_chunks_len = 0;
+
+// Depth is stored per tile, so that each tile's depth is contiguous
+static render_tile_t tiles[RENDER_TILES_MAX];
+static vec2i_t tiles_size;
+static uint32_t tiles_len;
+static float *depth_buffer = NULL;
+static bool frame_needs_clear = false;
 
 static render_texture_t textures[TEXTURES_MAX];
 static uint32_t textures_len;
+static rgba_t texture_pixels[TEXTURE_PIXELS_MAX];
+static uint32_t texture_pixels_len = 0;
+
+static render_stats_t stats = {0};
+static render_stats_t stats_last_frame = {0};
 
 uint16_t RENDER_NO_TEXTURE;
 
+static void render_flush();
+static void render_rasterize_select();
+
 
 void render_init(vec2i_t screen_size) {
+	render_rasterize_select();
 	render_set_screen_size(screen_size);
 	textures_len = 0;
+	texture_pixels_len = 0;
 
 	rgba_t white_pixels[4] = {
 		rgba(128,128,128,255), rgba(128,128,128,255),
@@ -43,21 +179,62 @@ void render_init(vec2i_t screen_size) {
 	RENDER_NO_TEXTURE = render_texture_create(2, 2, white_pixels);
 }
 
-void render_cleanup() {}
+void render_cleanup() {
+	free(depth_buffer);
+	depth_buffer = NULL;
+}
+
+static void render_tiles_reset() {
+	for (int i = 0; i < tiles_len; i++) {
+		tiles[i].first_chunk = -1;
+		tiles[i].last_chunk = -1;
+	}
+	bin_tris_len = 0;
+	bin_chunks_len = 0;
+}
 
 void render_set_screen_size(vec2i_t size) {
+	render_flush();
+	error_if(size.x > RENDER_SCREEN_SIZE_MAX || size.y > RENDER_SCREEN_SIZE_MAX, "Screen size %dx%d exceeds RENDER_SCREEN_SIZE_MAX", size.x, size.y);
 	screen_size = size;
 
+	tiles_size = vec2i(
+		(size.x + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE,
+		(size.y + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE
+	);
+	tiles_len = tiles_size.x * tiles_size.y;
+	error_if(tiles_len > RENDER_TILES_MAX, "Screen size %dx%d exceeds RENDER_TILES_MAX", size.x, size.y);
+	render_tiles_reset();
+
+	depth_buffer = realloc(depth_buffer, tiles_len * RENDER_TILE_SIZE * RENDER_TILE_SIZE * sizeof(float));
+	error_if(!depth_buffer, "Could not allocate depth buffer for %dx%d", size.x, size.y);
+
 	float aspect = (float)size.x / (float)size.y;
 	float fov = (73.75 / 180.0) * 3.14159265358;
 	float f = 1.0 / tan(fov / 2);
 	float nf = 1.0 / (NEAR_PLANE - FAR_PLANE);
 	projection_mat = mat4(
 		f / aspect, 0, 0, 0,
-		0, f, 0, 0, 
-		0, 0, (FAR_PLANE + NEAR_PLANE) * nf, -1, 
+		0, f, 0, 0,
+		0, 0, (FAR_PLANE + NEAR_PLANE) * nf, -1,
 		0, 0, 2 * FAR_PLANE * NEAR_PLANE * nf, 0
 	);
+
+	float near = -1;
+	float far = 1;
+	float left = 0;
+	float right = size.x;
+	float bottom = size.y;
+	float top = 0;
+	float lr = 1 / (left - right);
+	float bt = 1 / (bottom - top);
+	nf = 1 / (near - far);
+	projection_mat_2d = mat4(
+		-2 * lr,  0,  0,  0,
+		0,  -2 * bt,  0,  0,
+		0,        0,  2 * nf,    0,
+		(left + right) * lr, (top + bottom) * bt, (far + near) * nf, 1
+	);
 }
 
 void render_set_resolution(render_resolution_t res) {}
@@ -72,85 +249,330 @@ void render_frame_prepare() {
 	screen_buffer = platform_get_screenbuffer(&screen_pitch);
 	screen_ppr = screen_pitch / sizeof(rgba_t);
 
-	rgba_t color = rgba(0, 0, 0, 255);
-	for (uint32_t y = 0; y < screen_size.y; y++) {
-		for (uint32_t x = 0; x < screen_size.x; x++) {
-			screen_buffer[y * screen_ppr + x] = color;
-		}
-	}
+	// Tiles are cleared by the job threads before they draw their first tris
+	frame_needs_clear = true;
+	render_set_screen_position(vec2(0, 0));
+	render_set_depth_test(true);
+	render_set_depth_write(true);
+	render_set_depth_offset(0);
 }
 
-void render_frame_end() {}
+void render_frame_end() {
+	render_flush();
+	screen_buffer = NULL;
+
+	stats.textures_len = textures_len;
+	stats_last_frame = stats;
+	stats = (render_stats_t){0};
+}
+
+render_stats_t render_get_stats() {
+	return stats_last_frame;
+}
 
 void render_set_view(vec3_t pos, vec3_t angles) {
+	render_set_depth_write(true);
+	render_set_depth_test(true);
+
 	view_mat = mat4_identity();
 	mat4_set_translation(&view_mat, vec3(0, 0, 0));
 	mat4_set_roll_pitch_yaw(&view_mat, vec3(angles.x, -angles.y + M_PI, angles.z + M_PI));
 	mat4_translate(&view_mat, vec3_inv(pos));
 	mat4_set_yaw_pitch_roll(&sprite_mat, vec3(-angles.x, angles.y - M_PI, 0));
 
+	view_is_2d = false;
 	render_set_model_mat(&mat4_identity());
 }
 
 void render_set_view_2d() {
-	float near = -1;
-	float far = 1;
-	float left = 0;
-	float right = screen_size.x;
-	float bottom = screen_size.y;
-	float top = 0;
-	float lr = 1 / (left - right);
-	float bt = 1 / (bottom - top);
-	float nf = 1 / (near - far);
-	mvp_mat = mat4(
-		-2 * lr,  0,  0,  0,
-		0,  -2 * bt,  0,  0,
-		0,        0,  2 * nf,    0, 
-		(left + right) * lr, (top + bottom) * bt, (far + near) * nf, 1
-	);
+	render_set_depth_test(false);
+	render_set_depth_write(false);
+
+	view_is_2d = true;
+	render_set_model_mat(&mat4_identity());
 }
 
 void render_set_model_mat(mat4_t *m) {
-	mat4_t vm_mat;
-	mat4_mul(&vm_mat, &view_mat, m);
-	mat4_mul(&mvp_mat, &projection_mat, &vm_mat);
+	if (view_is_2d) {
+		mv_mat = *m;
+		mat4_mul(&mvp_mat, &projection_mat_2d, &mv_mat);
+	}
+	else {
+		mat4_mul(&mv_mat, &view_mat, m);
+		mat4_mul(&mvp_mat, &projection_mat, &mv_mat);
+	}
+	stats.state_changes++;
+}
+
+void render_set_depth_write(bool enabled) {
+	state.depth_write = enabled;
+	stats.state_changes++;
+}
+
+void render_set_depth_test(bool enabled) {
+	state.depth_test = enabled;
+	stats.state_changes++;
 }
 
-void render_set_depth_write(bool enabled) {}
-void render_set_depth_test(bool enabled) {}
-void render_set_depth_offset(float offset) {}
-void render_set_screen_position(vec2_t pos) {}
-void render_set_blend_mode(render_blend_mode_t mode) {}
-void render_set_cull_backface(bool enabled) {}
+void render_set_depth_offset(float offset) {
+	state.depth_offset = offset;
+	stats.state_changes++;
+}
+
+void render_set_screen_position(vec2_t pos) {
+	screen_position = vec2(pos.x, -pos.y);
+	stats.state_changes++;
+}
+
+void render_set_blend_mode(render_blend_mode_t mode) {
+	state.blend_mode = mode;
+	stats.state_changes++;
+}
+
+void render_set_cull_backface(bool enabled) {
+	state.cull_backface = enabled;
+	stats.state_changes++;
+}
+
+void render_push_matrix() {}
+void render_pop_matrix() {}
 
 vec3_t render_transform(vec3_t pos) {
 	return vec3_transform(vec3_transform(pos, &view_mat), &projection_mat);
 }
 
-void render_push_tris(tris_t tris, uint16_t texture_index) {
+frustum_t render_frustum() {
+	mat4_t view_projection;
+	mat4_mul(&view_projection, &projection_mat, &view_mat);
+	return frustum_from_mat4(&view_projection);
+}
+
+
+
+// -----------------------------------------------------------------------------
+// Clipping and setup
+
+static inline float clip_distance(clip_vertex_t *v, int plane) {
+	switch (plane) {
+		case 0: return v->z + v->w;
+		case 1: return v->x + v->w * RENDER_GUARD_BAND;
+		case 2: return v->w * RENDER_GUARD_BAND - v->x;
+		case 3: return v->y + v->w * RENDER_GUARD_BAND;
+		default: return v->w * RENDER_GUARD_BAND - v->y;
+	}
+}
+
+static inline clip_code_t clip_code(clip_vertex_t *v) {
+	clip_code_t cc = 0;
+	for (int i = 0; i < CLIP_PLANES; i++) {
+		if (clip_distance(v, i) < 0) {
+			flags_add(cc, 1 << i);
+		}
+	}
+	return cc;
+}
+
+static inline clip_vertex_t clip_vertex_lerp(clip_vertex_t *a, clip_vertex_t *b, float t) {
+	return (clip_vertex_t){
+		.x = lerp(a->x, b->x, t), .y = lerp(a->y, b->y, t),
+		.z = lerp(a->z, b->z, t), .w = lerp(a->w, b->w, t),
+		.u = lerp(a->u, b->u, t), .v = lerp(a->v, b->v, t),
+		.r = lerp(a->r, b->r, t), .g = lerp(a->g, b->g, t),
+		.b = lerp(a->b, b->b, t), .a = lerp(a->a, b->a, t)
+	};
+}
+
+static uint32_t clip_polygon(clip_vertex_t *in, uint32_t len, clip_vertex_t *out, int plane) {
+	// Sutherland-Hodgman against one plane
+	uint32_t out_len = 0;
+	for (int i = 0; i < len; i++) {
+		clip_vertex_t *a = &in[i];
+		clip_vertex_t *b = &in[(i + 1) % len];
+		float da = clip_distance(a, plane);
+		float db = clip_distance(b, plane);
+		if (da >= 0) {
+			out[out_len++] = *a;
+		}
+		if ((da >= 0) != (db >= 0)) {
+			out[out_len++] = clip_vertex_lerp(a, b, da / (da - db));
+		}
+	}
+	return out_len;
+}
+
+static void render_bin_push(uint32_t tile_index, uint32_t tris_index) {
+	render_tile_t *tile = &tiles[tile_index];
+	if (tile->last_chunk < 0 || bin_chunks[tile->last_chunk].len == RENDER_BIN_CHUNK_LEN) {
+		int32_t chunk_index = bin_chunks_len++;
+		bin_chunks[chunk_index].len = 0;
+		bin_chunks[chunk_index].next = -1;
+		if (tile->last_chunk < 0) {
+			tile->first_chunk = chunk_index;
+			stats.draw_calls++;
+		}
+		else {
+			bin_chunks[tile->last_chunk].next = chunk_index;
+		}
+		tile->last_chunk = chunk_index;
+	}
+	render_bin_chunk_t *chunk = &bin_chunks[tile->last_chunk];
+	chunk->tris[chunk->len++] = tris_index;
+}
+
+static void render_setup_tris(clip_vertex_t *v0, clip_vertex_t *v1, clip_vertex_t *v2, uint16_t texture_index) {
+	clip_vertex_t *v[3] = {v0, v1, v2};
+	raster_tris_t t;
+
 	float w2 = screen_size.x * 0.5;
 	float h2 = screen_size.y * 0.5;
+	float attr[3][RASTER_ATTRIBUTES];
+	float sx[3], sy[3];
+	for (int i = 0; i < 3; i++) {
+		float inv_w = 1.0 / v[i]->w;
+		sx[i] = (v[i]->x * inv_w) * w2 + w2;
+		sy[i] = h2 - (v[i]->y * inv_w) * h2;
+		t.x[i] = lrintf(sx[i] * RENDER_SUBPIXEL_SCALE);
+		t.y[i] = lrintf(sy[i] * RENDER_SUBPIXEL_SCALE);
+
+		attr[i][RASTER_Z] = v[i]->z * inv_w * 0.5 + 0.5;
+		attr[i][RASTER_INV_W] = inv_w;
+		attr[i][RASTER_U] = v[i]->u * inv_w;
+		attr[i][RASTER_V] = v[i]->v * inv_w;
+		attr[i][RASTER_R] = v[i]->r * inv_w;
+		attr[i][RASTER_G] = v[i]->g * inv_w;
+		attr[i][RASTER_B] = v[i]->b * inv_w;
+		attr[i][RASTER_A] = v[i]->a * inv_w;
+	}
 
-	vec3_t p0 = vec3_transform(tris.vertices[0].pos, &mvp_mat);
-	vec3_t p1 = vec3_transform(tris.vertices[1].pos, &mvp_mat);
-	vec3_t p2 = vec3_transform(tris.vertices[2].pos, &mvp_mat);
-	if (p0.z >= 1.0 || p1.z >= 1.0 || p2.z >= 1.0) {
+	// Front faces are counter clockwise in clip space, which is clockwise
+	// with y pointing down and gives a negative area here.
+	int64_t area =
+		(int64_t)(t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) -
+		(int64_t)(t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+	if (area == 0 || (area > 0 && state.cull_backface)) {
 		return;
 	}
+	if (area < 0) {
+		swap(t.x[1], t.x[2]);
+		swap(t.y[1], t.y[2]);
+		swap(sx[1], sx[2]);
+		swap(sy[1], sy[2]);
+		for (int i = 0; i < RASTER_ATTRIBUTES; i++) {
+			swap(attr[1][i], attr[2][i]);
+		}
+	}
 
-	vec2i_t sc0 = vec2i(p0.x * w2 + w2, h2 - p0.y * h2);
-	vec2i_t sc1 = vec2i(p1.x * w2 + w2, h2 - p1.y * h2);
-	vec2i_t sc2 = vec2i(p2.x * w2 + w2, h2 - p2.y * h2);
+	t.min_x = max(min(t.x[0], min(t.x[1], t.x[2])) >> RENDER_SUBPIXEL_BITS, 0);
+	t.min_y = max(min(t.y[0], min(t.y[1], t.y[2])) >> RENDER_SUBPIXEL_BITS, 0);
+	t.max_x = min(max(t.x[0], max(t.x[1], t.x[2])) >> RENDER_SUBPIXEL_BITS, screen_size.x - 1);
+	t.max_y = min(max(t.y[0], max(t.y[1], t.y[2])) >> RENDER_SUBPIXEL_BITS, screen_size.y - 1);
+	if (t.min_x > t.max_x || t.min_y > t.max_y) {
+		return;
+	}
 
-	rgba_t color = tris.vertices[0].color;
-	color.as_rgba.r = min(color.as_rgba.r * 2, 255);
-	color.as_rgba.g = min(color.as_rgba.g * 2, 255);
-	color.as_rgba.b = min(color.as_rgba.b * 2, 255);
-	color.as_rgba.a = clamp(color.as_rgba.a * (1.0-p0.z) * FAR_PLANE * (2.0/255.0), 0, 255);
+	float ax = sx[1] - sx[0], ay = sy[1] - sy[0];
+	float bx = sx[2] - sx[0], by = sy[2] - sy[0];
+	float inv_area = 1.0 / (ax * by - bx * ay);
+	t.origin_x = sx[0];
+	t.origin_y = sy[0];
+	for (int i = 0; i < RASTER_ATTRIBUTES; i++) {
+		float da = attr[1][i] - attr[0][i];
+		float db = attr[2][i] - attr[0][i];
+		t.base[i] = attr[0][i];
+		t.dx[i] = (da * by - db * ay) * inv_area;
+		t.dy[i] = (db * ax - da * bx) * inv_area;
+	}
+
+	// Same as glPolygonOffset(depth_offset, 1.0) with a 24 bit depth buffer
+	float z_offset = 0;
+	if (state.depth_offset != 0) {
+		float slope = max(fabsf(t.dx[RASTER_Z]), fabsf(t.dy[RASTER_Z]));
+		z_offset = state.depth_offset * slope + 1.0 / (1 << 24);
+		t.base[RASTER_Z] += z_offset;
+	}
+	t.min_z = min(attr[0][RASTER_Z], min(attr[1][RASTER_Z], attr[2][RASTER_Z])) + z_offset - RENDER_HIZ_EPSILON;
+
+	t.texture = texture_index;
+	t.state = state;
+
+	uint32_t tx0 = t.min_x / RENDER_TILE_SIZE;
+	uint32_t ty0 = t.min_y / RENDER_TILE_SIZE;
+	uint32_t tx1 = t.max_x / RENDER_TILE_SIZE;
+	uint32_t ty1 = t.max_y / RENDER_TILE_SIZE;
+	uint32_t tiles_covered = (tx1 - tx0 + 1) * (ty1 - ty0 + 1);
+	if (
+		bin_tris_len >= RENDER_BIN_TRIS_MAX ||
+		bin_chunks_len + tiles_covered > RENDER_BIN_CHUNKS_MAX
+	) {
+		render_flush();
+	}
 
-	line(sc0, sc1, color);
-	line(sc1, sc2, color);
-	line(sc2, sc0, color);
+	uint32_t tris_index = bin_tris_len++;
+	bin_tris[tris_index] = t;
+	for (uint32_t ty = ty0; ty <= ty1; ty++) {
+		for (uint32_t tx = tx0; tx <= tx1; tx++) {
+			render_bin_push(ty * tiles_size.x + tx, tris_index);
+		}
+	}
+	stats.tris++;
+}
+
+void render_push_tris(tris_t tris, uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+
+	clip_vertex_t buffers[2][RENDER_CLIP_VERTICES_MAX];
+	clip_vertex_t *in = buffers[0];
+	clip_code_t cc_and = ~0;
+	clip_code_t cc_or = 0;
+
+	float *m = mvp_mat.m;
+	for (int i = 0; i < 3; i++) {
+		vertex_t *v = &tris.vertices[i];
+		vec3_t p = v->pos;
+		clip_vertex_t *c = &in[i];
+		c->x = m[0] * p.x + m[4] * p.y + m[ 8] * p.z + m[12];
+		c->y = m[1] * p.x + m[5] * p.y + m[ 9] * p.z + m[13];
+		c->z = m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14];
+		c->w = m[3] * p.x + m[7] * p.y + m[11] * p.z + m[15];
+		c->x += screen_position.x * c->w;
+		c->y += screen_position.y * c->w;
+		c->u = v->uv.x;
+		c->v = v->uv.y;
+		c->r = v->color.as_rgba.r;
+		c->g = v->color.as_rgba.g;
+		c->b = v->color.as_rgba.b;
+		c->a = v->color.as_rgba.a;
+
+		// Fade out with the distance to the camera, same as the GL shader
+		if (!view_is_2d) {
+			vec3_t vp = vec3_transform(p, &mv_mat);
+			float t = clamp((vec3_len(vp) - FAR_PLANE) / (RENDER_FADEOUT_NEAR - FAR_PLANE), 0.0, 1.0);
+			c->a *= t * t * (3.0 - 2.0 * t);
+		}
+
+		clip_code_t cc = clip_code(c);
+		cc_and &= cc;
+		cc_or |= cc;
+	}
+
+	if (cc_and) {
+		return;
+	}
+
+	uint32_t len = 3;
+	if (cc_or) {
+		clip_vertex_t *out = buffers[1];
+		for (int plane = 0; plane < CLIP_PLANES && len >= 3; plane++) {
+			if (flags_is(cc_or, 1 << plane)) {
+				len = clip_polygon(in, len, out, plane);
+				swap(in, out);
+			}
+		}
+	}
+
+	for (int i = 1; i + 1 < len; i++) {
+		render_setup_tris(&in[0], &in[i], &in[i + 1], texture_index);
+	}
 }
 
 void render_push_sprite(vec3_t pos, vec2i_t size, rgba_t color, uint16_t texture_index) {
@@ -202,168 +624,372 @@ void render_push_2d_tile(vec2i_t pos, vec2i_t uv_offset, vec2i_t uv_size, vec2i_
 }
 
 
-uint16_t render_texture_create(uint32_t width, uint32_t height, rgba_t *pixels) {
-	error_if(textures_len >= TEXTURES_MAX, "TEXTURES_MAX reached");
-
-	uint32_t byte_size = width * height * sizeof(rgba_t);
-	uint16_t texture_index = textures_len;
-	
-	textures[texture_index] = (render_texture_t){{width, height}, NULL};
-	// textures[texture_index] = (render_texture_t){{width, height}, mem_bump(byte_size)};
-	// memcpy(textures[texture_index].pixels, pixels, byte_size);
 
-	textures_len++;
-	return texture_index;
-}
+// -----------------------------------------------------------------------------
+// Rasterization
 
-vec2i_t render_texture_size(uint16_t texture_index) {
-	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
-	return textures[texture_index].size;
+typedef struct {
+	int32_t min_x, min_y, max_x, max_y;
+	int32_t edge[3];
+	int32_t step_x[3];
+	int32_t step_y[3];
+} raster_bounds_t;
+
+// Clip the bounds of a tris to a tile and set up the edge functions at the
+// center of the top left pixel. min_x is aligned down to a multiple of align
+// within the tile, so that spans of align pixels never cross a tile row.
+//
+// Pixels exactly on an edge are only drawn for top and left edges, so that
+// pixels on an edge shared by two tris are drawn once. Within a tile the edge
+// functions change by less than 2^30, so clamping the start value keeps the
+// sign for every pixel exact and lets the rest run in 32 bit.
+static bool render_raster_bounds(raster_tris_t *t, int32_t tile_x, int32_t tile_y, int32_t align, raster_bounds_t *r) {
+	r->min_x = max(t->min_x, tile_x);
+	r->min_y = max(t->min_y, tile_y);
+	r->max_x = min(t->max_x, min(tile_x + RENDER_TILE_SIZE, screen_size.x) - 1);
+	r->max_y = min(t->max_y, min(tile_y + RENDER_TILE_SIZE, screen_size.y) - 1);
+	if (r->min_x > r->max_x || r->min_y > r->max_y) {
+		return false;
+	}
+	r->min_x = tile_x + ((r->min_x - tile_x) & ~(align - 1));
+
+	int32_t px = (r->min_x << RENDER_SUBPIXEL_BITS) + RENDER_SUBPIXEL_SCALE / 2;
+	int32_t py = (r->min_y << RENDER_SUBPIXEL_BITS) + RENDER_SUBPIXEL_SCALE / 2;
+	for (int i = 0; i < 3; i++) {
+		int j = (i + 1) % 3;
+		int k = (i + 2) % 3;
+		int64_t a = t->y[j] - t->y[k];
+		int64_t b = t->x[k] - t->x[j];
+		bool is_top_left = a > 0 || (a == 0 && b > 0);
+		int64_t edge = a * (px - t->x[j]) + b * (py - t->y[j]) - (is_top_left ? 0 : 1);
+		r->edge[i] = clamp(edge, -(1 << 30), (1 << 30));
+		r->step_x[i] = a * RENDER_SUBPIXEL_SCALE;
+		r->step_y[i] = b * RENDER_SUBPIXEL_SCALE;
+	}
+	return true;
 }
 
-void render_texture_replace_pixels(int16_t texture_index, rgba_t *pixels) {
-	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
-	render_texture_t *t = &textures[texture_index];
-	// memcpy(t->pixels, pixels, t->size.x * t->size.y * sizeof(rgba_t));
-}
+// The scalar rasterizer; the SIMD versions in render_software_span.h must
+// produce exactly the same pixels, so all math here is done in float in the
+// same order. Only the 8x8 blocks set in the blocks mask are drawn; blocks
+// that had depth written are added to blocks_written.
+static void render_rasterize_tris_x1(raster_tris_t *t, int32_t tile_x, int32_t tile_y, float *depth, uint64_t blocks, uint64_t *blocks_written) {
+	raster_bounds_t r;
+	if (!render_raster_bounds(t, tile_x, tile_y, 1, &r)) {
+		return;
+	}
 
-uint16_t render_textures_len() {
-	return textures_len;
-}
+	render_texture_t *texture = &textures[t->texture];
+	rgba_t *texels = texture_pixels + texture->offset;
+	int32_t tw = texture->size.x;
+	int32_t th = texture->size.y;
+	render_state_t *s = &t->state;
+
+	for (int32_t y = r.min_y; y <= r.max_y; y++, r.edge[0] += r.step_y[0], r.edge[1] += r.step_y[1], r.edge[2] += r.step_y[2]) {
+		int32_t block_row = ((y - tile_y) / RENDER_HIZ_BLOCK_SIZE) * RENDER_HIZ_BLOCKS_PER_ROW;
+		uint32_t row_blocks = (blocks >> block_row) & 0xff;
+		if (!row_blocks) {
+			continue;
+		}
 
-void render_textures_reset(uint16_t len) {
-	error_if(len > textures_len, "Invalid texture reset len %d >= %d", len, textures_len);
-	textures_len = len;
-}
+		int32_t e0 = r.edge[0];
+		int32_t e1 = r.edge[1];
+		int32_t e2 = r.edge[2];
+		float fy = (float)y + 0.5f - t->origin_y;
+		rgba_t *dst = screen_buffer + y * screen_ppr;
+		float *dst_depth = depth + (y - tile_y) * RENDER_TILE_SIZE - tile_x;
+		uint32_t row_written = 0;
+
+		for (int32_t x = r.min_x; x <= r.max_x; x++, e0 += r.step_x[0], e1 += r.step_x[1], e2 += r.step_x[2]) {
+			uint32_t block = 1 << ((x - tile_x) / RENDER_HIZ_BLOCK_SIZE);
+			if ((e0 | e1 | e2) < 0 || !(row_blocks & block)) {
+				continue;
+			}
 
-void render_textures_dump(const char *path) {}
+			float fx = (float)x + 0.5f - t->origin_x;
+			#define attribute(A) (t->base[A] + t->dx[A] * fx + t->dy[A] * fy)
 
+			float z = attribute(RASTER_Z);
+			if (s->depth_test && z >= dst_depth[x]) {
+				continue;
+			}
 
+			float w = 1.0f / attribute(RASTER_INV_W);
+			int32_t u = clamp((int32_t)(attribute(RASTER_U) * w), 0, tw - 1);
+			int32_t v = clamp((int32_t)(attribute(RASTER_V) * w), 0, th - 1);
+			rgba_t texel = texels[v * tw + u];
 
-// -----------------------------------------------------------------------------
+			// Same as the GL shader: texture * color, discard if transparent,
+			// then double the brightness.
+			float a = (float)texel.as_rgba.a * attribute(RASTER_A) * w * (1.0f / 255.0f);
+			if (a < 0.5f) {
+				continue;
+			}
+			float r = min((float)texel.as_rgba.r * attribute(RASTER_R) * w * (2.0f / 255.0f), 255.0f);
+			float g = min((float)texel.as_rgba.g * attribute(RASTER_G) * w * (2.0f / 255.0f), 255.0f);
+			float b = min((float)texel.as_rgba.b * attribute(RASTER_B) * w * (2.0f / 255.0f), 255.0f);
+			#undef attribute
+
+			rgba_t *d = &dst[x];
+			float src_a = a * (1.0f / 255.0f);
+			if (s->blend_mode == RENDER_BLEND_NORMAL) {
+				float dst_a = 1.0f - src_a;
+				*d = rgba(
+					r * src_a + (float)d->as_rgba.r * dst_a,
+					g * src_a + (float)d->as_rgba.g * dst_a,
+					b * src_a + (float)d->as_rgba.b * dst_a,
+					255
+				);
+			}
+			else {
+				*d = rgba(
+					min(r * src_a + (float)d->as_rgba.r, 255.0f),
+					min(g * src_a + (float)d->as_rgba.g, 255.0f),
+					min(b * src_a + (float)d->as_rgba.b, 255.0f),
+					255
+				);
+			}
 
-static inline rgba_t color_mix(rgba_t in, rgba_t out) {
-	return rgba(
-		lerp(in.as_rgba.r, out.as_rgba.r, out.as_rgba.a/255.0),
-		lerp(in.as_rgba.g, out.as_rgba.g, out.as_rgba.a/255.0),
-		lerp(in.as_rgba.b, out.as_rgba.b, out.as_rgba.a/255.0),
-		1
-	);
+			if (s->depth_write) {
+				dst_depth[x] = z;
+				row_written |= block;
+			}
+		}
+		*blocks_written |= (uint64_t)row_written << block_row;
+	}
 }
 
-typedef enum {
-	CLIP_INSIDE = 0,
-	CLIP_LEFT   = (1<<0),
-	CLIP_RIGHT  = (1<<1),
-	CLIP_BOTTOM = (1<<2),
-	CLIP_TOP    = (1<<3),
-} clip_code_t;
+// SIMD versions of the rasterizer; 4 wide with SSE2 or NEON and 8 wide with
+// AVX2, which is only used if the cpu supports it. Build with
+// RENDER_SIMD_WIDTH_MAX=1 to always use the scalar version.
+#ifndef RENDER_SIMD_WIDTH_MAX
+	#define RENDER_SIMD_WIDTH_MAX 8
+#endif
+
+#if RENDER_SIMD_WIDTH_MAX >= 4 && (defined(__SSE2__) || defined(__ARM_NEON))
+	#define SPAN_WIDTH 4
+	#define SPAN_NAME render_rasterize_tris_x4
+	#define SPAN_TARGET
+	#include "render_software_span.h"
+	#define RENDER_HAS_SPAN_X4
+#endif
+
+#if RENDER_SIMD_WIDTH_MAX >= 8 && defined(__x86_64__) && defined(__GNUC__)
+	#define SPAN_WIDTH 8
+	#define SPAN_NAME render_rasterize_tris_x8
+	#define SPAN_TARGET __attribute__((target("avx2")))
+	#include "render_software_span.h"
+	#define RENDER_HAS_SPAN_X8
+#endif
+
+static void (*render_rasterize_tris)(raster_tris_t *t, int32_t tile_x, int32_t tile_y, float *depth, uint64_t blocks, uint64_t *blocks_written) = render_rasterize_tris_x1;
+
+static void render_rasterize_select() {
+	render_rasterize_tris = render_rasterize_tris_x1;
+	#if defined(RENDER_HAS_SPAN_X4)
+		render_rasterize_tris = render_rasterize_tris_x4;
+	#endif
+	#if defined(RENDER_HAS_SPAN_X8)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			render_rasterize_tris = render_rasterize_tris_x8;
+		}
+	#endif
+}
 
-static inline clip_code_t clip_code(vec2i_t p) {
-	clip_code_t cc = CLIP_INSIDE;
-	if (p.x < 0) {
-		flags_add(cc, CLIP_LEFT);
-	}
-	else if (p.x >= screen_size.x) {
-		flags_add(cc, CLIP_RIGHT);	
+static void render_hiz_update(render_tile_t *tile, float *depth) {
+	if (!tile->depth_dirty_blocks) {
+		return;
 	}
-	if (p.y < 0) {
-		flags_add(cc, CLIP_BOTTOM);
+
+	for (int32_t b = 0; b < RENDER_HIZ_BLOCKS; b++) {
+		if (!(tile->depth_dirty_blocks & (1ull << b))) {
+			continue;
+		}
+		float *block_depth = depth +
+			(b / RENDER_HIZ_BLOCKS_PER_ROW) * RENDER_HIZ_BLOCK_SIZE * RENDER_TILE_SIZE +
+			(b % RENDER_HIZ_BLOCKS_PER_ROW) * RENDER_HIZ_BLOCK_SIZE;
+		float block_max = 0;
+		for (int32_t y = 0; y < RENDER_HIZ_BLOCK_SIZE; y++) {
+			for (int32_t x = 0; x < RENDER_HIZ_BLOCK_SIZE; x++) {
+				block_max = max(block_max, block_depth[y * RENDER_TILE_SIZE + x]);
+			}
+		}
+		tile->depth_max_blocks[b] = block_max;
 	}
-	else if (p.y >= screen_size.y) {
-		flags_add(cc, CLIP_TOP);	
+	tile->depth_dirty_blocks = 0;
+
+	tile->depth_max = 0;
+	for (int32_t b = 0; b < RENDER_HIZ_BLOCKS; b++) {
+		tile->depth_max = max(tile->depth_max, tile->depth_max_blocks[b]);
 	}
-	return cc;
 }
 
-static void line(vec2i_t p0, vec2i_t p1, rgba_t color) {
-	// Cohen Sutherland Line Clipping
-	clip_code_t cc0 = clip_code(p0);
-	clip_code_t cc1 = clip_code(p1);
-	bool accept = false;
+// Returns a mask of the 8x8 blocks covered by the tris' bounds in which it
+// may be visible. The nearest depth of the tris in a block is taken from its
+// depth plane at the block's corners.
+static uint64_t render_hiz_visible_blocks(render_tile_t *tile, raster_tris_t *t, int32_t tile_x, int32_t tile_y, float *depth) {
+	int32_t min_x = max(t->min_x, tile_x) - tile_x;
+	int32_t min_y = max(t->min_y, tile_y) - tile_y;
+	int32_t max_x = min(t->max_x, tile_x + RENDER_TILE_SIZE - 1) - tile_x;
+	int32_t max_y = min(t->max_y, tile_y + RENDER_TILE_SIZE - 1) - tile_y;
+	if (min_x > max_x || min_y > max_y) {
+		return 0;
+	}
 
-	vec2i_t ss = vec2i(screen_size.x-1, screen_size.y-1);
-	while (true) {
-		if (!(cc0 | cc1)) {
-			accept = true;
-			break;
-		}
-		else if (cc0 & cc1) {
-			break;
-		}
-		else {
-			vec2i_t r = p0;
-			clip_code_t cc_out = cc0 ? cc0 : cc1;
+	int32_t bx0 = min_x / RENDER_HIZ_BLOCK_SIZE, bx1 = max_x / RENDER_HIZ_BLOCK_SIZE;
+	int32_t by0 = min_y / RENDER_HIZ_BLOCK_SIZE, by1 = max_y / RENDER_HIZ_BLOCK_SIZE;
+	uint32_t blocks_len = (bx1 - bx0 + 1) * (by1 - by0 + 1);
 
-			if (flags_is(cc_out, CLIP_TOP)) {
-				r.x = p0.x + (p1.x - p0.x) * (ss.y - p0.y) / (p1.y - p0.y);
-				r.y = ss.y;
-			}
-			else if (flags_is(cc_out, CLIP_BOTTOM)) {
-				r.x = p0.x + (p1.x - p0.x) * (-p0.y) / (p1.y - p0.y);
-				r.y = 0;
-			}
-			else if (flags_is(cc_out, CLIP_RIGHT)) {
-				r.y = p0.y + (p1.y - p0.y) * (ss.x - p0.x) / (p1.x - p0.x);
-				r.x = ss.x;
-			}
-			else if (flags_is(cc_out, CLIP_LEFT)) {
-				r.y = p0.y + (p1.y - p0.y) * (-p0.x) / (p1.x - p0.x);
-				r.x = 0;
-			}
+	render_hiz_update(tile, depth);
+	if (t->min_z >= tile->depth_max) {
+		tile->hiz_hits += blocks_len;
+		return 0;
+	}
 
-			if (cc_out == cc0) {
-				p0.x = r.x;
-				p0.y = r.y;
-				cc0 = clip_code(p0);
+	uint64_t visible = 0;
+	float dx = t->dx[RASTER_Z];
+	float dy = t->dy[RASTER_Z];
+	for (int32_t by = by0; by <= by1; by++) {
+		float fy0 = tile_y + max(by * RENDER_HIZ_BLOCK_SIZE, min_y) + 0.5f - t->origin_y;
+		float fy1 = tile_y + min(by * RENDER_HIZ_BLOCK_SIZE + RENDER_HIZ_BLOCK_SIZE - 1, max_y) + 0.5f - t->origin_y;
+		float z_y = min(dy * fy0, dy * fy1);
+		for (int32_t bx = bx0; bx <= bx1; bx++) {
+			float fx0 = tile_x + max(bx * RENDER_HIZ_BLOCK_SIZE, min_x) + 0.5f - t->origin_x;
+			float fx1 = tile_x + min(bx * RENDER_HIZ_BLOCK_SIZE + RENDER_HIZ_BLOCK_SIZE - 1, max_x) + 0.5f - t->origin_x;
+			float z_min = max(t->base[RASTER_Z] + min(dx * fx0, dx * fx1) + z_y - RENDER_HIZ_EPSILON, t->min_z);
+
+			int32_t b = by * RENDER_HIZ_BLOCKS_PER_ROW + bx;
+			if (z_min >= tile->depth_max_blocks[b]) {
+				tile->hiz_hits++;
 			}
 			else {
-				p1.x = r.x;
-				p1.y = r.y;
-				cc1 = clip_code(p1);
+				tile->hiz_misses++;
+				visible |= 1ull << b;
 			}
 		}
 	}
-	if (!accept) {
-		return;
-	}
+	return visible;
+}
 
-	// Bresenham's line algorithm
-	bool steep = false; 
-	if (abs(p0.x - p1.x) < abs(p0.y - p1.y)) {
-		swap(p0.x, p0.y); 
-		swap(p1.x, p1.y); 
-		steep = true;
-	} 
-	if (p0.x > p1.x) { 
-		swap(p0.x, p1.x); 
-		swap(p0.y, p1.y); 
-	} 
-	int32_t dx = p1.x - p0.x; 
-	int32_t dy = p1.y - p0.y; 
-	int32_t derror2 = abs(dy) * 2; 
-	int32_t error2 = 0; 
-	int32_t y = p0.y;
-	int32_t ydir = (p1.y > p0.y ? 1 : -1);
-
-	if (steep) {
-		for (int32_t x = p0.x; x <= p1.x; x++) {
-			screen_buffer[x * screen_ppr + y] = color_mix(screen_buffer[x * screen_ppr + y], color);
-			error2 += derror2; 
-			if (error2 > dx) { 
-				y += ydir;
-				error2 -= dx * 2; 
-			} 
+static void render_rasterize_tile(void *data, uint32_t tile_index) {
+	render_tile_t *tile = &tiles[tile_index];
+	int32_t tile_x = (tile_index % tiles_size.x) * RENDER_TILE_SIZE;
+	int32_t tile_y = (tile_index / tiles_size.x) * RENDER_TILE_SIZE;
+	float *depth = depth_buffer + tile_index * RENDER_TILE_SIZE * RENDER_TILE_SIZE;
+
+	if (frame_needs_clear) {
+		int32_t w = min(RENDER_TILE_SIZE, screen_size.x - tile_x);
+		int32_t h = min(RENDER_TILE_SIZE, screen_size.y - tile_y);
+		for (int32_t y = 0; y < h; y++) {
+			rgba_t *dst = screen_buffer + (tile_y + y) * screen_ppr + tile_x;
+			for (int32_t x = 0; x < w; x++) {
+				dst[x] = rgba(0, 0, 0, 255);
+			}
 		}
+		for (int32_t i = 0; i < RENDER_TILE_SIZE * RENDER_TILE_SIZE; i++) {
+			depth[i] = 1.0;
+		}
+		tile->depth_max = 1.0;
+		for (int32_t i = 0; i < RENDER_HIZ_BLOCKS; i++) {
+			tile->depth_max_blocks[i] = 1.0;
+		}
+		tile->depth_dirty_blocks = 0;
 	}
-	else {
-		for (int32_t x = p0.x; x <= p1.x; x++) {
-			screen_buffer[y * screen_ppr + x] = color_mix(screen_buffer[y * screen_ppr + x], color);
-			error2 += derror2; 
-			if (error2 > dx) { 
-				y += ydir;
-				error2 -= dx * 2; 
-			} 
+
+	for (int32_t c = tile->first_chunk; c >= 0; c = bin_chunks[c].next) {
+		render_bin_chunk_t *chunk = &bin_chunks[c];
+		for (uint32_t i = 0; i < chunk->len; i++) {
+			raster_tris_t *t = &bin_tris[chunk->tris[i]];
+			uint64_t blocks = ~0ull;
+			#if RENDER_USE_HIZ
+				if (t->state.depth_test) {
+					blocks = render_hiz_visible_blocks(tile, t, tile_x, tile_y, depth);
+					if (!blocks) {
+						continue;
+					}
+				}
+			#endif
+			render_rasterize_tris(t, tile_x, tile_y, depth, blocks, &tile->depth_dirty_blocks);
 		}
 	}
 }
+
+static void render_flush() {
+	if (!screen_buffer) {
+		render_tiles_reset();
+		return;
+	}
+	if (bin_tris_len == 0 && !frame_needs_clear) {
+		return;
+	}
+
+	profiler_begin(PROFILER_ZONE_RENDER_FLUSH);
+	jobs_run(render_rasterize_tile, NULL, tiles_len);
+	profiler_end(PROFILER_ZONE_RENDER_FLUSH);
+
+	for (int i = 0; i < tiles_len; i++) {
+		stats.hiz_hits += tiles[i].hiz_hits;
+		stats.hiz_misses += tiles[i].hiz_misses;
+		tiles[i].hiz_hits = 0;
+		tiles[i].hiz_misses = 0;
+	}
+	stats.flushes++;
+	frame_needs_clear = false;
+	render_tiles_reset();
+}
+
+
+
+// -----------------------------------------------------------------------------
+// Textures
+
+uint16_t render_texture_create(uint32_t width, uint32_t height, rgba_t *pixels) {
+	error_if(textures_len >= TEXTURES_MAX, "TEXTURES_MAX reached");
+	error_if(texture_pixels_len + width * height > TEXTURE_PIXELS_MAX, "TEXTURE_PIXELS_MAX reached");
+
+	uint16_t texture_index = textures_len;
+	textures[texture_index] = (render_texture_t){{width, height}, texture_pixels_len};
+	memcpy(texture_pixels + texture_pixels_len, pixels, width * height * sizeof(rgba_t));
+	texture_pixels_len += width * height;
+	stats.bytes_uploaded += width * height * sizeof(rgba_t);
+
+	textures_len++;
+	return texture_index;
+}
+
+void render_textures_create(uint32_t len, vec2i_t *sizes, rgba_t **pixels) {
+	for (uint32_t i = 0; i < len; i++) {
+		render_texture_create(sizes[i].x, sizes[i].y, pixels[i]);
+	}
+}
+
+vec2i_t render_texture_size(uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+	return textures[texture_index].size;
+}
+
+void render_texture_replace_pixels(int16_t texture_index, rgba_t *pixels) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+
+	// Tris that are already binned must still see the old pixels
+	render_flush();
+	render_texture_t *t = &textures[texture_index];
+	memcpy(texture_pixels + t->offset, pixels, t->size.x * t->size.y * sizeof(rgba_t));
+	stats.bytes_uploaded += t->size.x * t->size.y * sizeof(rgba_t);
+}
+
+uint16_t render_textures_len() {
+	return textures_len;
+}
+
+void render_textures_reset(uint16_t len) {
+	error_if(len > textures_len, "Invalid texture reset len %d >= %d", len, textures_len);
+	render_flush();
+	if (len < textures_len) {
+		texture_pixels_len = textures[len].offset;
+	}
+	textures_len = len;
+}
+
+void render_textures_dump(const char *path) {}
@@ -0,0 +1,186 @@
+// SIMD version of render_rasterize_tris_x1(), SPAN_WIDTH pixels at a time.
+// Written with the gcc/clang vector extensions and included from
+// render_software.c once for each width, with SPAN_WIDTH, SPAN_NAME and
+// SPAN_TARGET defined. All math must stay in the same order as in the scalar
+// version, so that each version produces exactly the same pixels.
+//
+// Texels are still fetched one lane at a time; everything else runs on
+// SPAN_WIDTH lanes.
+
+#define SPAN_CAT_(A, B) A##B
+#define SPAN_CAT(A, B) SPAN_CAT_(A, B)
+#define span_f32_t SPAN_CAT(span_f32x, SPAN_WIDTH)
+#define span_i32_t SPAN_CAT(span_i32x, SPAN_WIDTH)
+#define span_any SPAN_CAT(span_any_x, SPAN_WIDTH)
+
+typedef float span_f32_t __attribute__((vector_size(SPAN_WIDTH * 4)));
+typedef int32_t span_i32_t __attribute__((vector_size(SPAN_WIDTH * 4)));
+
+// Masks are -1 for lanes that are set and 0 otherwise
+#define span_select(M, A, B) (((A) & (M)) | ((B) & ~(M)))
+#define span_select_f(M, A, B) ((span_f32_t)span_select(M, (span_i32_t)(A), (span_i32_t)(B)))
+#define span_min_f(A, B) span_select_f((A) < (B), A, B)
+
+static inline SPAN_TARGET __attribute__((always_inline)) bool span_any(span_i32_t mask) {
+	int32_t any = 0;
+	for (int i = 0; i < SPAN_WIDTH; i++) {
+		any |= mask[i];
+	}
+	return any != 0;
+}
+
+static SPAN_TARGET void SPAN_NAME(raster_tris_t *t, int32_t tile_x, int32_t tile_y, float *depth, uint64_t blocks, uint64_t *blocks_written) {
+	raster_bounds_t r;
+	if (!render_raster_bounds(t, tile_x, tile_y, SPAN_WIDTH, &r)) {
+		return;
+	}
+
+	render_texture_t *texture = &textures[t->texture];
+	uint32_t *texels = &texture_pixels[texture->offset].as_uint32;
+	int32_t tw = texture->size.x;
+	int32_t th = texture->size.y;
+	render_state_t *s = &t->state;
+	int32_t right = min(tile_x + RENDER_TILE_SIZE, screen_size.x);
+
+	span_i32_t lane;
+	for (int i = 0; i < SPAN_WIDTH; i++) {
+		lane[i] = i;
+	}
+	span_f32_t c255 = (span_f32_t){0} + 255.0f;
+	int32_t step_x0 = r.step_x[0] * SPAN_WIDTH;
+	int32_t step_x1 = r.step_x[1] * SPAN_WIDTH;
+	int32_t step_x2 = r.step_x[2] * SPAN_WIDTH;
+
+	for (int32_t y = r.min_y; y <= r.max_y; y++, r.edge[0] += r.step_y[0], r.edge[1] += r.step_y[1], r.edge[2] += r.step_y[2]) {
+		int32_t block_row = ((y - tile_y) / RENDER_HIZ_BLOCK_SIZE) * RENDER_HIZ_BLOCKS_PER_ROW;
+		uint32_t row_blocks = (blocks >> block_row) & 0xff;
+		if (!row_blocks) {
+			continue;
+		}
+
+		span_i32_t e0 = r.edge[0] + lane * r.step_x[0];
+		span_i32_t e1 = r.edge[1] + lane * r.step_x[1];
+		span_i32_t e2 = r.edge[2] + lane * r.step_x[2];
+		float fy = (float)y + 0.5f - t->origin_y;
+		float dy_fy[RASTER_ATTRIBUTES];
+		for (int i = 0; i < RASTER_ATTRIBUTES; i++) {
+			dy_fy[i] = t->dy[i] * fy;
+		}
+		rgba_t *dst = screen_buffer + y * screen_ppr;
+		float *dst_depth = depth + (y - tile_y) * RENDER_TILE_SIZE - tile_x;
+		uint32_t row_written = 0;
+
+		for (int32_t x = r.min_x; x <= r.max_x; x += SPAN_WIDTH, e0 += step_x0, e1 += step_x1, e2 += step_x2) {
+			// Spans are aligned within the tile, so they never cross a block
+			uint32_t block = 1 << ((x - tile_x) / RENDER_HIZ_BLOCK_SIZE);
+			if (!(row_blocks & block)) {
+				continue;
+			}
+			span_i32_t xs = x + lane;
+			span_i32_t mask = ((e0 | e1 | e2) >= 0) & (xs <= r.max_x);
+			if (!span_any(mask)) {
+				continue;
+			}
+
+			span_f32_t fx = __builtin_convertvector(xs, span_f32_t) + 0.5f - t->origin_x;
+			#define attribute(A) (t->base[A] + t->dx[A] * fx + dy_fy[A])
+
+			// Spans never cross a tile row, so depth can always be loaded
+			// whole; the screen only for spans inside the screen.
+			int32_t valid = min(SPAN_WIDTH, right - x);
+			span_f32_t d;
+			span_i32_t c = {0};
+			memcpy(&d, dst_depth + x, sizeof(d));
+			if (valid == SPAN_WIDTH) {
+				memcpy(&c, dst + x, sizeof(c));
+			}
+			else {
+				for (int i = 0; i < valid; i++) {
+					c[i] = dst[x + i].as_uint32;
+				}
+			}
+
+			span_f32_t z = attribute(RASTER_Z);
+			if (s->depth_test) {
+				mask &= ~(z >= d);
+			}
+
+			span_f32_t w = 1.0f / attribute(RASTER_INV_W);
+			span_i32_t u = __builtin_convertvector(attribute(RASTER_U) * w, span_i32_t);
+			span_i32_t v = __builtin_convertvector(attribute(RASTER_V) * w, span_i32_t);
+			u = span_select(u < 0, 0, u);
+			u = span_select(u > tw - 1, tw - 1, u);
+			v = span_select(v < 0, 0, v);
+			v = span_select(v > th - 1, th - 1, v);
+
+			span_i32_t index = v * tw + u;
+			span_i32_t texel;
+			for (int i = 0; i < SPAN_WIDTH; i++) {
+				texel[i] = texels[index[i]];
+			}
+
+			span_f32_t a = __builtin_convertvector((texel >> 24) & 0xff, span_f32_t) * attribute(RASTER_A) * w * (1.0f / 255.0f);
+			mask &= ~(a < 0.5f);
+			if (!span_any(mask)) {
+				continue;
+			}
+			span_f32_t cr = __builtin_convertvector(texel & 0xff, span_f32_t) * attribute(RASTER_R) * w * (2.0f / 255.0f);
+			span_f32_t cg = __builtin_convertvector((texel >> 8) & 0xff, span_f32_t) * attribute(RASTER_G) * w * (2.0f / 255.0f);
+			span_f32_t cb = __builtin_convertvector((texel >> 16) & 0xff, span_f32_t) * attribute(RASTER_B) * w * (2.0f / 255.0f);
+			cr = span_min_f(cr, c255);
+			cg = span_min_f(cg, c255);
+			cb = span_min_f(cb, c255);
+			#undef attribute
+
+			span_f32_t dr = __builtin_convertvector(c & 0xff, span_f32_t);
+			span_f32_t dg = __builtin_convertvector((c >> 8) & 0xff, span_f32_t);
+			span_f32_t db = __builtin_convertvector((c >> 16) & 0xff, span_f32_t);
+			span_f32_t src_a = a * (1.0f / 255.0f);
+			if (s->blend_mode == RENDER_BLEND_NORMAL) {
+				span_f32_t dst_a = 1.0f - src_a;
+				cr = cr * src_a + dr * dst_a;
+				cg = cg * src_a + dg * dst_a;
+				cb = cb * src_a + db * dst_a;
+			}
+			else {
+				cr = span_min_f(cr * src_a + dr, c255);
+				cg = span_min_f(cg * src_a + dg, c255);
+				cb = span_min_f(cb * src_a + db, c255);
+			}
+
+			span_i32_t out =
+				__builtin_convertvector(cr, span_i32_t) |
+				(__builtin_convertvector(cg, span_i32_t) << 8) |
+				(__builtin_convertvector(cb, span_i32_t) << 16) |
+				(int32_t)0xff000000;
+			c = span_select(mask, out, c);
+			if (valid == SPAN_WIDTH) {
+				memcpy(dst + x, &c, sizeof(c));
+			}
+			else {
+				for (int i = 0; i < valid; i++) {
+					dst[x + i].as_uint32 = c[i];
+				}
+			}
+
+			if (s->depth_write) {
+				d = span_select_f(mask, z, d);
+				memcpy(dst_depth + x, &d, sizeof(d));
+				row_written |= block;
+			}
+		}
+		*blocks_written |= (uint64_t)row_written << block_row;
+	}
+}
+
+#undef span_any
+#undef span_min_f
+#undef span_select_f
+#undef span_select
+#undef span_i32_t
+#undef span_f32_t
+#undef SPAN_CAT
+#undef SPAN_CAT_
+#undef SPAN_TARGET
+#undef SPAN_NAME
+#undef SPAN_WIDTH
@@ -0,0 +1,287 @@
+#include "stream.h"
+#include "jobs.h"
+#include "utils.h"
+
+#include "wipeout/lzss.h"
+
+#if JOBS_USE_THREADS
+
+#include <pthread.h>
+
+typedef enum {
+	STREAM_FILE_FREE,
+	STREAM_FILE_QUEUED,
+	STREAM_FILE_LOADING,
+	STREAM_FILE_READY,
+	STREAM_FILE_TAKEN,
+} stream_file_state_t;
+
+typedef struct {
+	char path[PAK_PATH_LEN];
+	stream_file_state_t state;
+	pak_entry_type_t type;
+	uint8_t *bytes;
+	uint32_t size;
+} stream_file_t;
+
+// Files are read in the order they were queued. The loader thread only
+// touches a file while it is LOADING; everything else happens under the lock
+// on the main thread.
+
+static stream_file_t files[STREAM_FILES_MAX];
+static pthread_t thread;
+static bool thread_is_running = false;
+static bool wants_to_exit = false;
+static uint32_t queue_next = 0;
+static uint32_t queue_len = 0;
+static uint8_t queue[STREAM_FILES_MAX];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t ready_cond = PTHREAD_COND_INITIALIZER;
+
+static bool stream_is_cmp(char *path) {
+	size_t len = strlen(path);
+	return len > 4 && strcmp(path + len - 4, ".cmp") == 0;
+}
+
+// Runs on the loader thread. Failures just leave bytes at NULL; the main
+// thread then loads the file itself and reports the error.
+static uint8_t *stream_read(char *path, uint32_t *size) {
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *bytes = malloc(*size);
+	if (bytes && fread(bytes, 1, *size, f) != *size) {
+		free(bytes);
+		bytes = NULL;
+	}
+	fclose(f);
+	return bytes;
+}
+
+static uint8_t *stream_decompress_cmp(uint8_t *compressed_bytes, uint32_t compressed_size, uint32_t *size) {
+	if (compressed_size < 4) {
+		return NULL;
+	}
+	uint32_t p = 0;
+	int32_t image_count = get_i32_le(compressed_bytes, &p);
+	uint32_t header_size = 4 + image_count * 4;
+	if (image_count < 0 || header_size > compressed_size) {
+		return NULL;
+	}
+
+	uint32_t decompressed_size = 0;
+	for (int i = 0; i < image_count; i++) {
+		decompressed_size += get_i32_le(compressed_bytes, &p);
+	}
+
+	uint8_t *bytes = malloc(header_size + decompressed_size);
+	if (bytes) {
+		memcpy(bytes, compressed_bytes, header_size);
+		lzss_decompress(compressed_bytes + header_size, compressed_size - header_size, bytes + header_size, decompressed_size);
+		*size = header_size + decompressed_size;
+	}
+	return bytes;
+}
+
+static void *stream_thread(void *arg) {
+	pthread_mutex_lock(&lock);
+	while (true) {
+		while (queue_next == queue_len && !wants_to_exit) {
+			pthread_cond_wait(&work_cond, &lock);
+		}
+		if (wants_to_exit) {
+			break;
+		}
+
+		stream_file_t *file = &files[queue[queue_next++]];
+		file->state = STREAM_FILE_LOADING;
+		pthread_mutex_unlock(&lock);
+
+		uint32_t size = 0;
+		uint8_t *bytes = stream_read(file->path, &size);
+		if (bytes && file->type == PAK_ENTRY_CMP_DECOMPRESSED) {
+			uint8_t *decompressed = stream_decompress_cmp(bytes, size, &size);
+			free(bytes);
+			bytes = decompressed;
+		}
+
+		pthread_mutex_lock(&lock);
+		file->bytes = bytes;
+		file->size = size;
+		file->state = STREAM_FILE_READY;
+		pthread_cond_broadcast(&ready_cond);
+	}
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+void stream_init() {
+	wants_to_exit = false;
+	thread_is_running = (pthread_create(&thread, NULL, stream_thread, NULL) == 0);
+	if (!thread_is_running) {
+		printf("Could not create loader thread; loading synchronously\n");
+	}
+}
+
+void stream_cleanup() {
+	if (!thread_is_running) {
+		return;
+	}
+	pthread_mutex_lock(&lock);
+	wants_to_exit = true;
+	pthread_cond_signal(&work_cond);
+	pthread_mutex_unlock(&lock);
+	pthread_join(thread, NULL);
+	thread_is_running = false;
+
+	for (int i = 0; i < STREAM_FILES_MAX; i++) {
+		free(files[i].bytes);
+		files[i] = (stream_file_t){.state = STREAM_FILE_FREE};
+	}
+	queue_next = 0;
+	queue_len = 0;
+}
+
+static stream_file_t *stream_find(char *path) {
+	for (int i = 0; i < STREAM_FILES_MAX; i++) {
+		if (
+			files[i].state != STREAM_FILE_FREE && files[i].state != STREAM_FILE_TAKEN &&
+			strncmp(files[i].path, path, PAK_PATH_LEN) == 0
+		) {
+			return &files[i];
+		}
+	}
+	return NULL;
+}
+
+void stream_prefetch(char *path) {
+	uint32_t pak_size;
+	pak_entry_type_t pak_type;
+	if (!thread_is_running || pak_find(path, &pak_size, &pak_type)) {
+		return;
+	}
+	error_if(strlen(path) >= PAK_PATH_LEN, "Stream path %s too long", path);
+
+	pthread_mutex_lock(&lock);
+	if (stream_find(path)) {
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+
+	// All files queued before are read by now when the queue is full
+	if (queue_len == STREAM_FILES_MAX) {
+		while (queue_next < queue_len || (queue_len && files[queue[queue_len - 1]].state == STREAM_FILE_LOADING)) {
+			pthread_cond_wait(&ready_cond, &lock);
+		}
+		queue_next = 0;
+		queue_len = 0;
+	}
+
+	int index = -1;
+	for (int i = 0; i < STREAM_FILES_MAX && index < 0; i++) {
+		if (files[i].state == STREAM_FILE_FREE) {
+			index = i;
+		}
+	}
+	error_if(index < 0, "STREAM_FILES_MAX reached");
+
+	stream_file_t *file = &files[index];
+	strcpy(file->path, path);
+	file->state = STREAM_FILE_QUEUED;
+	file->type = stream_is_cmp(path) ? PAK_ENTRY_CMP_DECOMPRESSED : PAK_ENTRY_RAW;
+	file->bytes = NULL;
+	file->size = 0;
+	queue[queue_len++] = index;
+	pthread_cond_signal(&work_cond);
+	pthread_mutex_unlock(&lock);
+}
+
+bool stream_is_ready(char *path) {
+	if (!thread_is_running) {
+		return true;
+	}
+	pthread_mutex_lock(&lock);
+	stream_file_t *file = stream_find(path);
+	bool is_ready = !file || file->state == STREAM_FILE_READY;
+	pthread_mutex_unlock(&lock);
+	return is_ready;
+}
+
+uint8_t *stream_take(char *path, uint32_t *size, pak_entry_type_t *type) {
+	if (!thread_is_running) {
+		return NULL;
+	}
+	pthread_mutex_lock(&lock);
+	stream_file_t *file = stream_find(path);
+	if (!file) {
+		pthread_mutex_unlock(&lock);
+		return NULL;
+	}
+	while (file->state != STREAM_FILE_READY) {
+		pthread_cond_wait(&ready_cond, &lock);
+	}
+
+	uint8_t *bytes = file->bytes;
+	*size = file->size;
+	*type = file->type;
+	file->state = bytes ? STREAM_FILE_TAKEN : STREAM_FILE_FREE;
+	pthread_mutex_unlock(&lock);
+	return bytes;
+}
+
+bool stream_release(void *bytes) {
+	if (!thread_is_running || !bytes) {
+		return false;
+	}
+	pthread_mutex_lock(&lock);
+	bool was_staged = false;
+	for (int i = 0; i < STREAM_FILES_MAX; i++) {
+		if (files[i].state == STREAM_FILE_TAKEN && files[i].bytes == bytes) {
+			free(files[i].bytes);
+			files[i] = (stream_file_t){.state = STREAM_FILE_FREE};
+			was_staged = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	return was_staged;
+}
+
+void stream_reset() {
+	if (!thread_is_running) {
+		return;
+	}
+	pthread_mutex_lock(&lock);
+
+	// Unqueue everything not yet started, wait for the one being read
+	queue_len = queue_next;
+	for (int i = 0; i < STREAM_FILES_MAX; i++) {
+		while (files[i].state == STREAM_FILE_LOADING) {
+			pthread_cond_wait(&ready_cond, &lock);
+		}
+		if (files[i].state == STREAM_FILE_QUEUED || files[i].state == STREAM_FILE_READY) {
+			free(files[i].bytes);
+			files[i] = (stream_file_t){.state = STREAM_FILE_FREE};
+		}
+	}
+	queue_next = 0;
+	queue_len = 0;
+	pthread_mutex_unlock(&lock);
+}
+
+#else
+
+void stream_init() {}
+void stream_cleanup() {}
+void stream_prefetch(char *path) {}
+bool stream_is_ready(char *path) { return true; }
+uint8_t *stream_take(char *path, uint32_t *size, pak_entry_type_t *type) { return NULL; }
+bool stream_release(void *bytes) { return false; }
+void stream_reset() {}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "types.h"
+#include "pak.h"
+
+// Reads files on a loader thread ahead of their use, so that loading them
+// doesn't stall the main loop. .cmp files are decompressed there as well and
+// staged in the layout of a PAK_ENTRY_CMP_DECOMPRESSED entry. Staged files
+// are picked up by file_map() and image_load_compressed(); they live in
+// memory of their own until they are released again, or until
+// stream_reset() drops the ones that were never taken.
+// Files in a mounted pak are not staged. Without threads, stream_prefetch()
+// does nothing and all files are read when they are needed.
+
+#define STREAM_FILES_MAX 32
+
+void stream_init();
+void stream_cleanup();
+
+// Queue the file at path to be read on the loader thread
+void stream_prefetch(char *path);
+
+// Whether taking the file at path would return without waiting
+bool stream_is_ready(char *path);
+
+// The staged bytes of the file at path, or NULL if it was not prefetched.
+// Waits for the loader thread if the file is not yet read.
+uint8_t *stream_take(char *path, uint32_t *size, pak_entry_type_t *type);
+
+// Release bytes returned by stream_take(). Returns false if they were not
+// staged.
+bool stream_release(void *bytes);
+
+// Drop all staged files that were not taken
+void stream_reset();
+
+#endif
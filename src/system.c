@@ -4,6 +4,9 @@
 #include "platform.h"
 #include "mem.h"
 #include "utils.h"
+#include "profiler.h"
+#include "jobs.h"
+#include "stream.h"
 
 #include "wipeout/game.h"
 
@@ -11,17 +14,22 @@ static scalar_t time_real;
 static scalar_t time_scaled;
 static scalar_t time_scale = 1.0;
 static scalar_t tick_last;
+static scalar_t tick_fixed = 0;
 static scalar_t cycle_time = 0;
 
 void system_init() {
 	time_real = platform_now();
 	input_init();
+	jobs_init(JOBS_THREADS_AUTO);
+	stream_init();
 	render_init(platform_screen_size());
 	game_init();
 }
 
 void system_cleanup() {
 	render_cleanup();
+	stream_cleanup();
+	jobs_cleanup();
 	input_cleanup();
 }
 
@@ -33,7 +41,7 @@ void system_update() {
 	scalar_t time_real_now = platform_now();
 	scalar_t real_delta = time_real_now - time_real;
 	time_real = time_real_now;
-	tick_last = min(real_delta, 0.1) * time_scale;
+	tick_last = (tick_fixed > 0 ? tick_fixed : min(real_delta, 0.1)) * time_scale;
 	time_scaled += tick_last;
 
 	// FIXME: come up with a better way to wrap the cycle_time, so that it
@@ -50,6 +58,7 @@ void system_update() {
 	render_frame_end();
 	input_clear();
 	mem_temp_check();
+	profiler_frame_end();
 }
 
 void system_reset_cycle_time() {
@@ -68,6 +77,12 @@ void system_time_scale_set(scalar_t scale) {
 	time_scale = scale;
 }
 
+void system_fixed_tick_set(scalar_t tick) {
+	// Advance the game by a constant tick each frame, regardless of the real
+	// time that has passed. A tick of 0 goes back to real time.
+	tick_fixed = tick;
+}
+
 scalar_t system_tick() {
 	return tick_last;
 }
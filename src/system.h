@@ -19,5 +19,6 @@ scalar_t system_cycle_time();
 void system_reset_cycle_time();
 scalar_t system_time_scale_get();
 void system_time_scale_set(scalar_t ts);
+void system_fixed_tick_set(scalar_t tick);
 
 #endif
@@ -0,0 +1,253 @@
+// Benchmarks lzss_decompress() against the original bit-by-bit decoder and
+// checks that both produce the same bytes for every .cmp file.
+//
+// Usage: wipeout-lzss-bench [--runs N] <files or directories...>
+//
+// Directories are searched recursively for .cmp files, e.g.:
+//   wipeout-lzss-bench wipeout/
+//
+// Exits with 1 if any file decodes differently.
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../wipeout/lzss.h"
+#include "tools.h"
+
+
+// The original decoder, kept as the reference. Its window is zeroed here
+// (it was left uninitialized), so that streams reaching into the unwritten
+// window decode the same as with lzss_decompress().
+
+#define LZSS_INDEX_BIT_COUNT  13
+#define LZSS_LENGTH_BIT_COUNT 4
+#define LZSS_WINDOW_SIZE      (1 << LZSS_INDEX_BIT_COUNT)
+#define LZSS_BREAK_EVEN       ((1 + LZSS_INDEX_BIT_COUNT + LZSS_LENGTH_BIT_COUNT) / 9)
+#define LZSS_END_OF_STREAM    0
+#define LZSS_MOD_WINDOW(a)    ((a) & (LZSS_WINDOW_SIZE - 1))
+
+static void lzss_decompress_reference(uint8_t *in_data, uint8_t *out_data) {
+	int16_t i;
+	int16_t current_position;
+	uint8_t cc;
+	int16_t match_length;
+	int16_t match_position;
+	uint32_t mask;
+	uint32_t return_value;
+	uint8_t in_bfile_mask;
+	int16_t in_bfile_rack;
+	int16_t value;
+	uint8_t window[LZSS_WINDOW_SIZE] = {0};
+
+	in_bfile_rack = 0;
+	in_bfile_mask = 0x80;
+
+	current_position = 1;
+	while (true) {
+		if (in_bfile_mask == 0x80) {
+			in_bfile_rack = (int16_t) * in_data++;
+		}
+
+		value = in_bfile_rack & in_bfile_mask;
+		in_bfile_mask >>= 1;
+		if (in_bfile_mask == 0) {
+			in_bfile_mask = 0x80;
+		}
+
+		if (value) {
+			mask = 1L << (8 - 1);
+			return_value = 0;
+			while (mask != 0) {
+				if (in_bfile_mask == 0x80) {
+					in_bfile_rack = (int16_t) * in_data++;
+				}
+
+				if (in_bfile_rack & in_bfile_mask) {
+					return_value |= mask;
+				}
+				mask >>= 1;
+				in_bfile_mask >>= 1;
+
+				if (in_bfile_mask == 0) {
+					in_bfile_mask = 0x80;
+				}
+			}
+			cc = (uint8_t) return_value;
+			*out_data++ = cc;
+			window[ current_position ] = cc;
+			current_position = LZSS_MOD_WINDOW(current_position + 1);
+		}
+		else {
+			mask = 1L << (LZSS_INDEX_BIT_COUNT - 1);
+			return_value = 0;
+			while (mask != 0) {
+				if (in_bfile_mask == 0x80) {
+					in_bfile_rack = (int16_t) * in_data++;
+				}
+
+				if (in_bfile_rack & in_bfile_mask) {
+					return_value |= mask;
+				}
+				mask >>= 1;
+				in_bfile_mask >>= 1;
+
+				if (in_bfile_mask == 0) {
+					in_bfile_mask = 0x80;
+				}
+			}
+			match_position = (int16_t) return_value;
+
+			if (match_position == LZSS_END_OF_STREAM) {
+				break;
+			}
+
+			mask = 1L << (LZSS_LENGTH_BIT_COUNT - 1);
+			return_value = 0;
+			while (mask != 0) {
+				if (in_bfile_mask == 0x80) {
+					in_bfile_rack = (int16_t) * in_data++;
+				}
+
+				if (in_bfile_rack & in_bfile_mask) {
+					return_value |= mask;
+				}
+				mask >>= 1;
+				in_bfile_mask >>= 1;
+
+				if (in_bfile_mask == 0) {
+					in_bfile_mask = 0x80;
+				}
+			}
+			match_length = (int16_t) return_value;
+
+			match_length += LZSS_BREAK_EVEN;
+
+			for (i = 0 ; i <= match_length ; i++) {
+				cc = window[LZSS_MOD_WINDOW(match_position + i)];
+				*out_data++ = cc;
+				window[current_position] = cc;
+				current_position = LZSS_MOD_WINDOW(current_position + 1);
+			}
+		}
+	}
+}
+
+
+typedef struct {
+	int runs;
+	int files;
+	int mismatches;
+	double compressed_bytes;
+	double decompressed_bytes;
+	double reference_time;
+	double time;
+} bench_t;
+
+static void bench_file(bench_t *bench, char *path) {
+	uint32_t size;
+	uint8_t *bytes = file_read(path, &size);
+	error_if(size < 4, "%s is truncated", path);
+	uint32_t p = 0;
+	uint32_t image_count = get_u32_le(bytes, &p);
+	uint32_t header_size = 4 + image_count * 4;
+	error_if(size < header_size, "%s is truncated", path);
+
+	uint32_t decompressed_size = 0;
+	for (int i = 0; i < image_count; i++) {
+		decompressed_size += get_u32_le(bytes, &p);
+	}
+
+	// The reference decoder has no bounds; give it some room to overrun
+	uint8_t *reference = calloc(decompressed_size + 0x10000, 1);
+	uint8_t *out = calloc(decompressed_size, 1);
+	error_if(!reference || !out, "Failed to allocate %d bytes for %s", decompressed_size, path);
+
+	double reference_time = 0;
+	double time = 0;
+	uint32_t written = 0;
+	for (int run = 0; run < bench->runs; run++) {
+		double start = now();
+		lzss_decompress_reference(bytes + header_size, reference);
+		double mid = now();
+		written = lzss_decompress(bytes + header_size, size - header_size, out, decompressed_size);
+		double end = now();
+		reference_time += mid - start;
+		time += end - mid;
+	}
+
+	bool matches = written == decompressed_size && memcmp(reference, out, decompressed_size) == 0;
+	printf(
+		"%-40s %9d %9d %8.3f %8.3f %s\n", path, size, decompressed_size,
+		reference_time * 1000 / bench->runs, time * 1000 / bench->runs,
+		matches ? "ok" : "MISMATCH"
+	);
+
+	bench->files++;
+	bench->mismatches += !matches;
+	bench->compressed_bytes += size;
+	bench->decompressed_bytes += decompressed_size;
+	bench->reference_time += reference_time / bench->runs;
+	bench->time += time / bench->runs;
+	free(out);
+	free(reference);
+	free(bytes);
+}
+
+static void bench_path(bench_t *bench, char *path) {
+	struct stat s;
+	error_if(stat(path, &s) != 0, "Could not stat %s", path);
+	if (!S_ISDIR(s.st_mode)) {
+		bench_file(bench, path);
+		return;
+	}
+
+	DIR *dir = opendir(path);
+	error_if(!dir, "Could not open directory %s", path);
+	struct dirent *entry;
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+		char child[4096];
+		snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+		struct stat cs;
+		if (stat(child, &cs) == 0 && (S_ISDIR(cs.st_mode) || has_extension(child, ".cmp"))) {
+			bench_path(bench, child);
+		}
+	}
+	closedir(dir);
+}
+
+int main(int argc, char *argv[]) {
+	bench_t bench = {.runs = 10};
+	int first_path = 1;
+	if (argc > 2 && strcmp(argv[1], "--runs") == 0) {
+		bench.runs = atoi(argv[2]);
+		first_path = 3;
+	}
+	if (first_path >= argc || bench.runs < 1) {
+		printf("Usage: %s [--runs N] <files or directories...>\n", argv[0]);
+		return 1;
+	}
+
+	printf("%-40s %9s %9s %8s %8s\n", "file", "in", "out", "ref ms", "new ms");
+	for (int i = first_path; i < argc; i++) {
+		bench_path(&bench, argv[i]);
+	}
+
+	if (bench.files > 0) {
+		printf(
+			"%d files, %.1f MB/s reference, %.1f MB/s new (%.2fx), %d mismatched\n",
+			bench.files,
+			bench.decompressed_bytes / bench.reference_time / (1024 * 1024),
+			bench.decompressed_bytes / bench.time / (1024 * 1024),
+			bench.reference_time / bench.time,
+			bench.mismatches
+		);
+	}
+	return bench.mismatches > 0 ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+// Builds a .pak archive from game files, to be mounted with pak_mount().
+//
+// Usage: wipeout-pack <out.pak> <files...>
+//
+// Run it from the directory the game runs in, so that the stored paths match
+// the ones the game asks for, e.g.:
+//   wipeout-pack wipeout/track01.pak wipeout/track01/*
+//
+// .cmp files are stored already decompressed; all other files as they are.
+// The archive is written in the byte order of this machine, so build it on
+// (or for) the machine it is used on.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../pak.h"
+#include "../wipeout/lzss.h"
+#include "tools.h"
+
+// Keep the header of the .cmp (image count and sizes), replace the compressed
+// stream with the decompressed images.
+static uint8_t *cmp_decompress(char *path, uint8_t *bytes, uint32_t *size) {
+	error_if(*size < 4, "%s is truncated", path);
+	uint32_t p = 0;
+	uint32_t image_count = get_u32_le(bytes, &p);
+	uint32_t header_size = 4 + image_count * 4;
+	error_if(*size < header_size, "%s is truncated", path);
+
+	uint32_t decompressed_size = 0;
+	for (int i = 0; i < image_count; i++) {
+		decompressed_size += get_u32_le(bytes, &p);
+	}
+
+	uint8_t *out = malloc(header_size + decompressed_size);
+	error_if(!out, "Failed to allocate %d bytes for %s", header_size + decompressed_size, path);
+	memcpy(out, bytes, header_size);
+	uint32_t written = lzss_decompress(bytes + header_size, *size - header_size, out + header_size, decompressed_size);
+	error_if(written != decompressed_size, "%s decompressed to %d bytes instead of %d", path, written, decompressed_size);
+	*size = header_size + decompressed_size;
+	return out;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 3) {
+		printf("Usage: %s <out.pak> <files...>\n", argv[0]);
+		return 1;
+	}
+
+	char *out_path = argv[1];
+	uint32_t entries_len = argc - 2;
+	uint32_t header_size = sizeof(pak_header_t) + sizeof(pak_entry_t) * entries_len;
+	header_size = (header_size + PAK_ALIGN - 1) & ~(PAK_ALIGN - 1);
+
+	pak_header_t *header = calloc(1, header_size);
+	error_if(!header, "Failed to allocate header");
+	header->magic = PAK_MAGIC;
+	header->version = PAK_VERSION;
+	header->entries_len = entries_len;
+
+	FILE *f = fopen(out_path, "wb");
+	error_if(!f, "Could not open file for writing: %s", out_path);
+	fseek(f, header_size, SEEK_SET);
+
+	static const uint8_t padding[PAK_ALIGN] = {0};
+	uint32_t offset = header_size;
+	for (int i = 0; i < entries_len; i++) {
+		char *path = argv[i + 2];
+		pak_entry_t *e = &header->entries[i];
+		error_if(strlen(path) >= PAK_PATH_LEN, "Path %s too long", path);
+
+		uint32_t size;
+		uint8_t *bytes = file_read(path, &size);
+		e->type = PAK_ENTRY_RAW;
+		if (has_extension(path, ".cmp")) {
+			uint8_t *decompressed = cmp_decompress(path, bytes, &size);
+			free(bytes);
+			bytes = decompressed;
+			e->type = PAK_ENTRY_CMP_DECOMPRESSED;
+		}
+
+		strcpy(e->path, path);
+		e->offset = offset;
+		e->size = size;
+
+		uint32_t padded_size = (size + PAK_ALIGN - 1) & ~(PAK_ALIGN - 1);
+		error_if(fwrite(bytes, 1, size, f) != size, "Could not write %s", out_path);
+		error_if(fwrite(padding, 1, padded_size - size, f) != padded_size - size, "Could not write %s", out_path);
+		offset += padded_size;
+		free(bytes);
+	}
+
+	fseek(f, 0, SEEK_SET);
+	error_if(fwrite(header, 1, header_size, f) != header_size, "Could not write %s", out_path);
+	fclose(f);
+	free(header);
+
+	printf("wrote %s with %d files, %d bytes\n", out_path, entries_len, offset);
+	return 0;
+}
@@ -0,0 +1,225 @@
+// Benchmarks tim_decode() against the original per pixel decoder and checks
+// that both produce the same pixels, for all TIM images in .tim files and
+// .cmp archives.
+//
+// Usage: wipeout-tim-bench [--runs N] <files or directories...>
+//
+// Directories are searched recursively, e.g.:
+//   wipeout-tim-bench wipeout/common wipeout/textures
+//
+// Each image is decoded both with and without the transparent bit. Exits
+// with 1 if any image decodes differently.
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "../wipeout/lzss.h"
+#include "../wipeout/tim.h"
+#include "tools.h"
+
+
+// The original decoder, kept as the reference
+
+#define TIM_TYPE_PALETTED_4_BPP 0x08
+#define TIM_TYPE_PALETTED_8_BPP 0x09
+#define TIM_TYPE_TRUE_COLOR_16_BPP 0x02
+
+static inline rgba_t tim_16bit_to_rgba(uint16_t c, bool transparent_bit) {
+	return rgba(
+		((c >>  0) & 0x1f) << 3,
+		((c >>  5) & 0x1f) << 3,
+		((c >> 10) & 0x1f) << 3,
+		(c == 0 
+			? 0x00
+			: transparent_bit && (c & 0x7fff) == 0 ? 0x00 : 0xff
+		)
+	);
+}
+
+static void tim_decode_reference(uint8_t *bytes, bool transparent, rgba_t *pixels) {
+	uint32_t p = 0;
+
+	uint32_t magic = get_i32_le(bytes, &p);
+	uint32_t type = get_i32_le(bytes, &p);
+	uint16_t *palette = NULL;
+
+	if (
+		type == TIM_TYPE_PALETTED_4_BPP ||
+		type == TIM_TYPE_PALETTED_8_BPP
+	) {
+		uint32_t header_length = get_i32_le(bytes, &p);
+		uint16_t palette_x = get_i16_le(bytes, &p);
+		uint16_t palette_y = get_i16_le(bytes, &p);
+		uint16_t palette_colors = get_i16_le(bytes, &p);
+		uint16_t palettes = get_i16_le(bytes, &p);
+		palette = (uint16_t *)(bytes + p);
+		p += palette_colors * 2;
+	}
+
+	uint32_t data_size = get_i32_le(bytes, &p);
+
+	uint16_t skip_x = get_i16_le(bytes, &p);
+	uint16_t skip_y = get_i16_le(bytes, &p);
+	uint16_t entries_per_row  = get_i16_le(bytes, &p);
+	uint16_t rows = get_i16_le(bytes, &p);
+
+	int32_t entries = entries_per_row * rows;
+	int32_t pixel_pos = 0;
+
+	if (type == TIM_TYPE_TRUE_COLOR_16_BPP) {
+		for (int i = 0; i < entries; i++) {
+			pixels[pixel_pos++] = tim_16bit_to_rgba(get_i16_le(bytes, &p), transparent);
+		}
+	}
+	else if (type == TIM_TYPE_PALETTED_8_BPP) {
+		for (int i = 0; i < entries; i++) {
+			int32_t palette_pos = get_i16_le(bytes, &p);
+			pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >> 0) & 0xff], transparent);
+			pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >> 8) & 0xff], transparent);
+		}
+	}
+	else if (type == TIM_TYPE_PALETTED_4_BPP) {
+		for (int i = 0; i < entries; i++) {
+			int32_t palette_pos = get_i16_le(bytes, &p);
+			pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >>  0) & 0xf], transparent);
+			pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >>  4) & 0xf], transparent);
+			pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >>  8) & 0xf], transparent);
+			pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >> 12) & 0xf], transparent);
+		}
+	}
+}
+
+
+typedef struct {
+	int runs;
+	int images;
+	int mismatches;
+	double pixels;
+	double reference_time;
+	double time;
+} bench_t;
+
+static void bench_image(bench_t *bench, uint8_t *bytes) {
+	vec2i_t size = tim_size(bytes);
+	uint32_t len = size.x * size.y;
+	rgba_t *reference = malloc(len * sizeof(rgba_t));
+	rgba_t *pixels = malloc(len * sizeof(rgba_t));
+	error_if(!reference || !pixels, "Failed to allocate %d pixels", len);
+
+	for (int transparent = 0; transparent < 2; transparent++) {
+		double start = now();
+		for (int run = 0; run < bench->runs; run++) {
+			tim_decode_reference(bytes, transparent, reference);
+		}
+		double mid = now();
+		for (int run = 0; run < bench->runs; run++) {
+			tim_decode(bytes, transparent, pixels);
+		}
+		double end = now();
+
+		bench->reference_time += (mid - start) / bench->runs;
+		bench->time += (end - mid) / bench->runs;
+		bench->pixels += len;
+		bench->mismatches += memcmp(reference, pixels, len * sizeof(rgba_t)) != 0;
+	}
+	bench->images++;
+	free(pixels);
+	free(reference);
+}
+
+static void bench_file(bench_t *bench, char *path) {
+	uint32_t size;
+	uint8_t *bytes = file_read(path, &size);
+	int mismatches = bench->mismatches;
+	int images = bench->images;
+
+	if (has_extension(path, ".tim")) {
+		bench_image(bench, bytes);
+	}
+	else {
+		uint32_t p = 0;
+		int32_t image_count = get_i32_le(bytes, &p);
+		uint32_t header_size = 4 + image_count * 4;
+		error_if(size < header_size, "%s is truncated", path);
+
+		uint32_t decompressed_size = 0;
+		for (int i = 0; i < image_count; i++) {
+			decompressed_size += get_i32_le(bytes, &p);
+		}
+		uint8_t *decompressed = malloc(decompressed_size);
+		error_if(!decompressed, "Failed to allocate %d bytes for %s", decompressed_size, path);
+		lzss_decompress(bytes + header_size, size - header_size, decompressed, decompressed_size);
+
+		p = 4;
+		for (uint32_t i = 0, offset = 0; i < image_count; i++) {
+			bench_image(bench, decompressed + offset);
+			offset += get_i32_le(bytes, &p);
+		}
+		free(decompressed);
+	}
+
+	printf(
+		"%-40s %4d images %s\n", path, bench->images - images,
+		bench->mismatches == mismatches ? "ok" : "MISMATCH"
+	);
+	free(bytes);
+}
+
+static void bench_path(bench_t *bench, char *path) {
+	struct stat s;
+	error_if(stat(path, &s) != 0, "Could not stat %s", path);
+	if (!S_ISDIR(s.st_mode)) {
+		bench_file(bench, path);
+		return;
+	}
+
+	DIR *dir = opendir(path);
+	error_if(!dir, "Could not open directory %s", path);
+	struct dirent *entry;
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+		char child[4096];
+		snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+		struct stat cs;
+		if (
+			stat(child, &cs) == 0 &&
+			(S_ISDIR(cs.st_mode) || has_extension(child, ".tim") || has_extension(child, ".cmp"))
+		) {
+			bench_path(bench, child);
+		}
+	}
+	closedir(dir);
+}
+
+int main(int argc, char *argv[]) {
+	bench_t bench = {.runs = 10};
+	int first_path = 1;
+	if (argc > 2 && strcmp(argv[1], "--runs") == 0) {
+		bench.runs = atoi(argv[2]);
+		first_path = 3;
+	}
+	if (first_path >= argc || bench.runs < 1) {
+		printf("Usage: %s [--runs N] <files or directories...>\n", argv[0]);
+		return 1;
+	}
+
+	for (int i = first_path; i < argc; i++) {
+		bench_path(&bench, argv[i]);
+	}
+
+	if (bench.images > 0) {
+		printf(
+			"%d images, %.1f Mpixels/s reference, %.1f Mpixels/s new (%.2fx), %d mismatched\n",
+			bench.images,
+			bench.pixels / bench.reference_time / 1e6,
+			bench.pixels / bench.time / 1e6,
+			bench.reference_time / bench.time,
+			bench.mismatches
+		);
+	}
+	return bench.mismatches > 0 ? 1 : 0;
+}
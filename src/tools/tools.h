@@ -0,0 +1,38 @@
+#ifndef TOOLS_H
+#define TOOLS_H
+
+// Helpers shared by the offline tools. These are built without the engine,
+// so they read files and time themselves without file_load()/platform_now().
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../utils.h"
+
+static inline double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline uint8_t *file_read(char *path, uint32_t *size) {
+	FILE *f = fopen(path, "rb");
+	error_if(!f, "Could not open file for reading: %s", path);
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *bytes = malloc(*size);
+	error_if(!bytes, "Failed to allocate %d bytes for %s", *size, path);
+	error_if(fread(bytes, 1, *size, f) != *size, "Could not read file: %s", path);
+	fclose(f);
+	return bytes;
+}
+
+static inline bool has_extension(char *path, char *ext) {
+	size_t len = strlen(path);
+	size_t ext_len = strlen(ext);
+	return len > ext_len && strcmp(path + len - ext_len, ext) == 0;
+}
+
+#endif
@@ -114,3 +114,50 @@ void mat4_mul(mat4_t *res, mat4_t *a, mat4_t *b) {
 	res->m[14] = b->m[12] * a->m[2] + b->m[13] * a->m[6] + b->m[14] * a->m[10] + b->m[15] * a->m[14];
 	res->m[15] = b->m[12] * a->m[3] + b->m[13] * a->m[7] + b->m[14] * a->m[11] + b->m[15] * a->m[15];
 }
+
+
+// Gribb & Hartmann: each plane of the clip volume is the 4th row of the
+// view_projection matrix plus or minus one of the other rows.
+frustum_t frustum_from_mat4(mat4_t *m) {
+	frustum_t f;
+	for (int i = 0; i < 6; i++) {
+		int row = i / 2;
+		float sign = (i & 1) ? -1 : 1;
+		vec3_t normal = vec3(
+			m->m[ 3] + m->m[row +  0] * sign,
+			m->m[ 7] + m->m[row +  4] * sign,
+			m->m[11] + m->m[row +  8] * sign
+		);
+		float distance = m->m[15] + m->m[row + 12] * sign;
+		float inv_len = 1.0 / vec3_len(normal);
+		f.planes[i].normal = vec3_mulf(normal, inv_len);
+		f.planes[i].distance = distance * inv_len;
+	}
+	return f;
+}
+
+bool frustum_sphere_visible(frustum_t *f, vec3_t center, float radius) {
+	for (int i = 0; i < 6; i++) {
+		plane_t *p = &f->planes[i];
+		if (vec3_dot(p->normal, center) + p->distance < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool frustum_aabb_visible(frustum_t *f, vec3_t min, vec3_t max) {
+	for (int i = 0; i < 6; i++) {
+		// Only test the corner that is furthest along the plane normal
+		plane_t *p = &f->planes[i];
+		vec3_t corner = vec3(
+			p->normal.x >= 0 ? max.x : min.x,
+			p->normal.y >= 0 ? max.y : min.y,
+			p->normal.z >= 0 ? max.z : min.z
+		);
+		if (vec3_dot(p->normal, corner) + p->distance < 0) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -48,12 +48,27 @@ typedef union {
 	float cols[4][4];
 } mat4_t;
 
+// Points p with vec3_dot(normal, p) + distance >= 0 are in front of the plane
+typedef struct {
+	vec3_t normal;
+	float distance;
+} plane_t;
+
+// Left, right, bottom, top, near, far; all facing inwards
+typedef struct {
+	plane_t planes[6];
+} frustum_t;
+
 #if defined(RENDERER_GL)
 	#include "render_gl_legacy_types.h"
 #elif defined(RENDERER_GL_LEGACY)
 	#include "render_gl_legacy_types.h"
 #elif defined(RENDERER_GU)
 	#include "render_gu_types.h"
+#elif defined(RENDERER_NULL)
+	#include "render_gl_types.h"
+#elif defined(RENDERER_SOFTWARE)
+	#include "render_gl_types.h"
 #else
 	#error "No vertex format found!"
 #endif
@@ -194,4 +209,8 @@ void mat4_set_roll_pitch_yaw(mat4_t *mat, vec3_t rot);
 void mat4_translate(mat4_t *mat, vec3_t translation);
 void mat4_mul(mat4_t *res, mat4_t *a, mat4_t *b);
 
+frustum_t frustum_from_mat4(mat4_t *view_projection);
+bool frustum_sphere_visible(frustum_t *f, vec3_t center, float radius);
+bool frustum_aabb_visible(frustum_t *f, vec3_t min, vec3_t max);
+
 #endif
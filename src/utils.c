@@ -4,6 +4,14 @@
 #include <sys/stat.h>
 #include "utils.h"
 #include "mem.h"
+#include "pak.h"
+#include "stream.h"
+
+#if FILE_USE_MMAP
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
 
 char temp_path[64];
 char *get_path(const char *dir, const char *file) {
@@ -18,7 +26,7 @@ bool file_exists(char *path) {
 	return (stat(path, &s) == 0);
 }
 
-uint8_t *file_load(char *path, uint32_t *bytes_read) {
+uint8_t *file_load_at(char *path, uint32_t *bytes_read, const char *file, int line) {
 #if defined(_arch_dreamcast)
 	char _path[256];
 	memset(_path, 0, sizeof(path));
@@ -38,7 +46,7 @@ uint8_t *file_load(char *path, uint32_t *bytes_read) {
 	}
 	fseek(f, 0, SEEK_SET);
 
-	uint8_t *bytes = mem_temp_alloc(size);
+	uint8_t *bytes = mem_temp_alloc_at(size, file, line);
 	if (!bytes) {
 		fclose(f);
 		return NULL;
@@ -51,6 +59,51 @@ uint8_t *file_load(char *path, uint32_t *bytes_read) {
 	return bytes;
 }
 
+uint8_t *file_map_at(char *path, uint32_t *bytes_read, const char *file, int line) {
+	pak_entry_type_t type;
+	uint8_t *pak_bytes = pak_find(path, bytes_read, &type);
+	if (pak_bytes && type == PAK_ENTRY_RAW) {
+		return pak_bytes;
+	}
+	uint8_t *stream_bytes = stream_take(path, bytes_read, &type);
+	if (stream_bytes && type == PAK_ENTRY_RAW) {
+		return stream_bytes;
+	}
+	stream_release(stream_bytes);
+
+#if FILE_USE_MMAP
+	int fd = open(path, O_RDONLY);
+	error_if(fd < 0, "Could not open file for reading: %s", path);
+
+	struct stat s;
+	if (fstat(fd, &s) != 0 || s.st_size <= 0) {
+		close(fd);
+		return NULL;
+	}
+
+	// The mapping stays valid after the file is closed
+	uint8_t *bytes = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	error_if(bytes == MAP_FAILED, "Could not map file: %s", path);
+
+	*bytes_read = s.st_size;
+	return bytes;
+#else
+	return file_load_at(path, bytes_read, file, line);
+#endif
+}
+
+void file_unmap(uint8_t *bytes, uint32_t len) {
+	if (pak_contains(bytes) || stream_release(bytes)) {
+		return;
+	}
+#if FILE_USE_MMAP
+	munmap(bytes, len);
+#else
+	mem_temp_free(bytes);
+#endif
+}
+
 uint32_t file_store(char *path, void *bytes, int32_t len) {
 	#if defined(_arch_dreamcast)
 		printf("file writing ignored! %s\n", path);
@@ -75,7 +75,26 @@ float rand_float(float min, float max);
 int32_t rand_int(int32_t min, int32_t max); 
 
 bool file_exists(char *path);
-uint8_t *file_load(char *path, uint32_t *bytes_read);
+#define file_load(PATH, BYTES_READ) file_load_at(PATH, BYTES_READ, __FILE__, __LINE__)
+uint8_t *file_load_at(char *path, uint32_t *bytes_read, const char *file, int line);
+
+#if !defined(FILE_USE_MMAP)
+	#if defined(__PSP__) || defined(_arch_dreamcast) || defined(__EMSCRIPTEN__) || defined(_WIN32)
+		#define FILE_USE_MMAP 0
+	#else
+		#define FILE_USE_MMAP 1
+	#endif
+#endif
+
+// Map a file read only, so that it can be parsed directly from the page
+// cache. The bytes must not be written to. Platforms without mmap fall back
+// to file_load(). Files in a mounted pak (see pak.h) or staged by the loader
+// thread (see stream.h) are returned as they are. Either way, release the
+// bytes with file_unmap().
+#define file_map(PATH, BYTES_READ) file_map_at(PATH, BYTES_READ, __FILE__, __LINE__)
+uint8_t *file_map_at(char *path, uint32_t *bytes_read, const char *file, int line);
+void file_unmap(uint8_t *bytes, uint32_t len);
+
 uint32_t file_store(char *path, void *bytes, int32_t len);
 
 
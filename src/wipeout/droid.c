@@ -108,6 +108,8 @@ void droid_draw(droid_t *droid) {
 		}
 	}
 
+	object_update_mesh(droid_model);
+
 	mat4_set_translation(&droid->mat, droid->position);
 	mat4_set_yaw_pitch_roll(&droid->mat, droid->angle);
 	object_draw(droid_model, &droid->mat);
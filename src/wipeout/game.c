@@ -5,6 +5,9 @@
 #include "../system.h"
 #include "../platform.h"
 #include "../input.h"
+#include "../profiler.h"
+#include "../pak.h"
+#include "../stream.h"
 
 #include "game.h"
 #include "ship.h"
@@ -496,9 +499,19 @@ struct {
 	[GAME_SCENE_RACE] = {race_init, race_update},
 };
 
+static const char *game_scene_names[] = {
+	[GAME_SCENE_INTRO] = "intro",
+	[GAME_SCENE_TITLE] = "title",
+	[GAME_SCENE_MAIN_MENU] = "main menu",
+	[GAME_SCENE_HIGHSCORES] = "highscores",
+	[GAME_SCENE_RACE] = "race",
+	[GAME_SCENE_NONE] = "none",
+};
+
 static game_scene_t scene_current = GAME_SCENE_NONE;
 static game_scene_t scene_next = GAME_SCENE_NONE;
 static int global_textures_len = 0;
+static int global_meshes_len = 0;
 static void *global_mem_mark = 0;
 
 void game_init() {
@@ -517,6 +530,8 @@ void game_init() {
 	render_set_post_effect(save.post_effect);
 
 	srand((int)(platform_now() * 100));
+
+	pak_mount("wipeout/common.pak");
 	
 	ui_load();
 	sfx_load();
@@ -527,6 +542,7 @@ void game_init() {
 	weapons_load();
 
 	global_textures_len = render_textures_len();
+	global_meshes_len = render_meshes_len();
 	global_mem_mark = mem_mark();
 
 	sfx_music_mode(SFX_MUSIC_PAUSED);
@@ -548,6 +564,9 @@ void game_init() {
 	input_bind(INPUT_LAYER_SYSTEM, INPUT_KEY_RETURN, A_MENU_START);
 	input_bind(INPUT_LAYER_SYSTEM, INPUT_KEY_ESCAPE, A_MENU_QUIT);
 
+	input_bind(INPUT_LAYER_SYSTEM, INPUT_KEY_F1, A_PROFILER_TOGGLE);
+	input_bind(INPUT_LAYER_SYSTEM, INPUT_KEY_F2, A_PROFILER_DUMP);
+
 	// Gamepad
 	input_bind(INPUT_LAYER_SYSTEM, INPUT_GAMEPAD_DPAD_UP, A_MENU_UP);
 	input_bind(INPUT_LAYER_SYSTEM, INPUT_GAMEPAD_DPAD_DOWN, A_MENU_DOWN);
@@ -598,6 +617,7 @@ void game_reset_championship() {
 
 void game_update() {
 	scalar_t frame_start_time = platform_now();
+	profiler_begin(PROFILER_ZONE_GAME_UPDATE);
 
 	int sh = render_size().y;
 	int scale = max(1, sh >=  720 ? sh / 360 : sh / 240);
@@ -611,7 +631,10 @@ void game_update() {
 		scene_current = scene_next;
 		scene_next = GAME_SCENE_NONE;
 		render_textures_reset(global_textures_len);
+		render_meshes_reset(global_meshes_len);
 		mem_reset(global_mem_mark);
+		stream_reset();
+		mem_set_scene(game_scene_names[scene_current]);
 		system_reset_cycle_time();
 
 		if (scene_current != GAME_SCENE_NONE) {
@@ -623,6 +646,19 @@ void game_update() {
 		game_scenes[scene_current].update();
 	}
 
+	if (input_pressed(A_PROFILER_TOGGLE)) {
+		profiler_set_enabled(!profiler_is_enabled());
+	}
+	if (input_pressed(A_PROFILER_DUMP)) {
+		profiler_dump_csv("profile.csv");
+		profiler_dump_trace("profile.json");
+		mem_report();
+	}
+	if (profiler_is_enabled()) {
+		render_set_view_2d();
+		hud_draw_profiler();
+	}
+
 	if (save.is_dirty) {
 		// FIXME: use a text based format?
 		// FIXME: this should probably run async somewhere
@@ -631,6 +667,7 @@ void game_update() {
 		printf("wrote save.dat\n");
 	}
 
+	profiler_end(PROFILER_ZONE_GAME_UPDATE);
 	scalar_t now = platform_now();
 	g.frame_time = now - frame_start_time;
 	if (g.frame_time > 0) {
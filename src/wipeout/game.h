@@ -39,6 +39,9 @@ typedef enum {
 	A_MENU_SELECT,
 	A_MENU_START,
 	A_MENU_QUIT,
+
+	A_PROFILER_TOGGLE,
+	A_PROFILER_DUMP,
 } action_t;
 
 
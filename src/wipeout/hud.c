@@ -2,6 +2,7 @@
 #include "../mem.h"
 #include "../utils.h"
 #include "../system.h"
+#include "../profiler.h"
 
 #include "object.h"
 #include "track.h"
@@ -242,3 +243,28 @@ void hud_draw(ship_t *ship) {
 		hud_draw_target_icon(ship->weapon_target->position);
 	}
 }
+
+static void hud_draw_ms(scalar_t time, vec2i_t pos, rgba_t color) {
+	// The font has no "." glyph; "f" maps to it, as in ui_draw_time()
+	char text[16];
+	int usec = time * 1000000;
+	snprintf(text, sizeof(text), "%df%03d", usec / 1000, usec % 1000);
+	ui_draw_text(text, pos, UI_SIZE_8, color);
+}
+
+void hud_draw_profiler() {
+	ui_draw_text("ZONE", ui_scaled(vec2i(16, 120)), UI_SIZE_8, UI_COLOR_ACCENT);
+	ui_draw_text("AVG MS", ui_scaled(vec2i(160, 120)), UI_SIZE_8, UI_COLOR_ACCENT);
+	ui_draw_text("MAX MS", ui_scaled(vec2i(230, 120)), UI_SIZE_8, UI_COLOR_ACCENT);
+	ui_draw_text("CALLS", ui_scaled(vec2i(300, 120)), UI_SIZE_8, UI_COLOR_ACCENT);
+
+	for (int i = 0; i < PROFILER_ZONE_MAX; i++) {
+		int y = 132 + i * 10;
+		profiler_sample_t avg = profiler_zone_average(i);
+		profiler_sample_t mx = profiler_zone_max(i);
+		ui_draw_text(profiler_zone_name(i), ui_scaled(vec2i(16, y)), UI_SIZE_8, UI_COLOR_DEFAULT);
+		hud_draw_ms(avg.duration, ui_scaled(vec2i(160, y)), UI_COLOR_DEFAULT);
+		hud_draw_ms(mx.duration, ui_scaled(vec2i(230, y)), UI_COLOR_DEFAULT);
+		ui_draw_number(avg.calls, ui_scaled(vec2i(300, y)), UI_SIZE_8, UI_COLOR_DEFAULT);
+	}
+}
@@ -5,5 +5,6 @@
 
 void hud_load();
 void hud_draw(ship_t *ship);
+void hud_draw_profiler();
 
 #endif
\ No newline at end of file
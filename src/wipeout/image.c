@@ -1,6 +1,9 @@
 #include "../types.h"
 #include "../mem.h"
 #include "../utils.h"
+#include "../pak.h"
+#include "../stream.h"
+#include "../jobs.h"
 
 #include "object.h"
 #include "track.h"
@@ -13,28 +16,14 @@
 #include "game.h"
 #include "hud.h"
 #include "image.h"
+#include "lzss.h"
+#include "tim.h"
 
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "../libs/stb_image_write.h"
 
 
-#define TIM_TYPE_PALETTED_4_BPP 0x08
-#define TIM_TYPE_PALETTED_8_BPP 0x09
-#define TIM_TYPE_TRUE_COLOR_16_BPP 0x02
-
-static inline rgba_t tim_16bit_to_rgba(uint16_t c, bool transparent_bit) {
-	return rgba(
-		((c >>  0) & 0x1f) << 3,
-		((c >>  5) & 0x1f) << 3,
-		((c >> 10) & 0x1f) << 3,
-		(c == 0 
-			? 0x00
-			: transparent_bit && (c & 0x7fff) == 0 ? 0x00 : 0xff
-		)
-	);
-}
-
 image_t *image_alloc(uint32_t width, uint32_t height) {
 	image_t *image = mem_temp_alloc(sizeof(image_t) + width * height * sizeof(rgba_t));
 	image->width = width;
@@ -44,189 +33,60 @@ image_t *image_alloc(uint32_t width, uint32_t height) {
 }
 
 image_t *image_load_from_bytes(uint8_t *bytes, bool transparent) {
-	uint32_t p = 0;
-
-	uint32_t magic = get_i32_le(bytes, &p);
-	uint32_t type = get_i32_le(bytes, &p);
-	uint16_t *palette = NULL;
-
-	if (
-		type == TIM_TYPE_PALETTED_4_BPP ||
-		type == TIM_TYPE_PALETTED_8_BPP
-	) {
-		uint32_t header_length = get_i32_le(bytes, &p);
-		uint16_t palette_x = get_i16_le(bytes, &p);
-		uint16_t palette_y = get_i16_le(bytes, &p);
-		uint16_t palette_colors = get_i16_le(bytes, &p);
-		uint16_t palettes = get_i16_le(bytes, &p);
-		palette = (uint16_t *)(bytes + p);
-		p += palette_colors * 2;
-	}
-
-	uint32_t data_size = get_i32_le(bytes, &p);
-
-	int32_t pixels_per_16bit = 1;
-	if (type == TIM_TYPE_PALETTED_8_BPP) {
-		pixels_per_16bit = 2;
-	}
-	else if (type == TIM_TYPE_PALETTED_4_BPP) {
-		pixels_per_16bit = 4;
-	}
-
-	uint16_t skip_x = get_i16_le(bytes, &p);
-	uint16_t skip_y = get_i16_le(bytes, &p);
-	uint16_t entries_per_row  = get_i16_le(bytes, &p);
-	uint16_t rows = get_i16_le(bytes, &p);
-
-	int32_t width = entries_per_row * pixels_per_16bit;
-	int32_t height = rows;
-	int32_t entries = entries_per_row * rows;
-
-	image_t *image = image_alloc(width, height);
-	int32_t pixel_pos = 0;
-
-	if (type == TIM_TYPE_TRUE_COLOR_16_BPP) {
-		for (int i = 0; i < entries; i++) {
-			image->pixels[pixel_pos++] = tim_16bit_to_rgba(get_i16_le(bytes, &p), transparent);
-		}
-	}
-	else if (type == TIM_TYPE_PALETTED_8_BPP) {
-		for (int i = 0; i < entries; i++) {
-			int32_t palette_pos = get_i16_le(bytes, &p);
-			image->pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >> 0) & 0xff], transparent);
-			image->pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >> 8) & 0xff], transparent);
-		}
-	}
-	else if (type == TIM_TYPE_PALETTED_4_BPP) {
-		for (int i = 0; i < entries; i++) {
-			int32_t palette_pos = get_i16_le(bytes, &p);
-			image->pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >>  0) & 0xf], transparent);
-			image->pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >>  4) & 0xf], transparent);
-			image->pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >>  8) & 0xf], transparent);
-			image->pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >> 12) & 0xf], transparent);
-		}
-	}
-
+	vec2i_t size = tim_size(bytes);
+	image_t *image = image_alloc(size.x, size.y);
+	tim_decode(bytes, transparent, image->pixels);
 	return image;
 }
 
-#define LZSS_INDEX_BIT_COUNT  13
-#define LZSS_LENGTH_BIT_COUNT 4
-#define LZSS_WINDOW_SIZE      (1 << LZSS_INDEX_BIT_COUNT)
-#define LZSS_BREAK_EVEN       ((1 + LZSS_INDEX_BIT_COUNT + LZSS_LENGTH_BIT_COUNT) / 9)
-#define LZSS_END_OF_STREAM    0
-#define LZSS_MOD_WINDOW(a)    ((a) & (LZSS_WINDOW_SIZE - 1))
-
-void lzss_decompress(uint8_t *in_data, uint8_t *out_data) {
-	int16_t i;
-	int16_t current_position;
-	uint8_t cc;
-	int16_t match_length;
-	int16_t match_position;
-	uint32_t mask;
-	uint32_t return_value;
-	uint8_t in_bfile_mask;
-	int16_t in_bfile_rack;
-	int16_t value;
-	uint8_t window[LZSS_WINDOW_SIZE];
-
-	in_bfile_rack = 0;
-	in_bfile_mask = 0x80;
-
-	current_position = 1;
-	while (true) {
-		if (in_bfile_mask == 0x80) {
-			in_bfile_rack = (int16_t) * in_data++;
-		}
-
-		value = in_bfile_rack & in_bfile_mask;
-		in_bfile_mask >>= 1;
-		if (in_bfile_mask == 0) {
-			in_bfile_mask = 0x80;
+cmp_t *image_load_compressed(char *name) {
+	printf("load cmp %s\n", name);
+	mem_tag_t mem_tag = mem_set_tag(MEM_TAG_TEXTURE);
+
+	// Packed archives and the loader thread provide the images already
+	// decompressed, behind the same header. Entries point straight into a
+	// pak; staged files are copied, so they can be released right away.
+	uint32_t bytes_size;
+	pak_entry_type_t type;
+	uint8_t *bytes = pak_find(name, &bytes_size, &type);
+	bool is_staged = false;
+	if (!bytes) {
+		bytes = stream_take(name, &bytes_size, &type);
+		is_staged = (bytes != NULL);
+	}
+	if (bytes && type == PAK_ENTRY_CMP_DECOMPRESSED) {
+		uint32_t p = 0;
+		int32_t image_count = get_i32_le(bytes, &p);
+		uint32_t header_size = 4 + image_count * 4;
+		uint32_t struct_size = sizeof(cmp_t) + sizeof(uint8_t *) * image_count;
+		error_if(header_size > bytes_size, "Decompressed %s is truncated", name);
+
+		cmp_t *cmp = mem_temp_alloc(struct_size + (is_staged ? bytes_size - header_size : 0));
+		cmp->len = image_count;
+		uint8_t *images = bytes + header_size;
+		if (is_staged) {
+			images = memcpy(((uint8_t *)cmp) + struct_size, images, bytes_size - header_size);
 		}
 
-		if (value) {
-			mask = 1L << (8 - 1);
-			return_value = 0;
-			while (mask != 0) {
-				if (in_bfile_mask == 0x80) {
-					in_bfile_rack = (int16_t) * in_data++;
-				}
-
-				if (in_bfile_rack & in_bfile_mask) {
-					return_value |= mask;
-				}
-				mask >>= 1;
-				in_bfile_mask >>= 1;
-
-				if (in_bfile_mask == 0) {
-					in_bfile_mask = 0x80;
-				}
-			}
-			cc = (uint8_t) return_value;
-			*out_data++ = cc;
-			window[ current_position ] = cc;
-			current_position = LZSS_MOD_WINDOW(current_position + 1);
+		uint32_t offset = 0;
+		for (int i = 0; i < image_count; i++) {
+			cmp->entries[i] = images + offset;
+			offset += get_i32_le(bytes, &p);
 		}
-		else {
-			mask = 1L << (LZSS_INDEX_BIT_COUNT - 1);
-			return_value = 0;
-			while (mask != 0) {
-				if (in_bfile_mask == 0x80) {
-					in_bfile_rack = (int16_t) * in_data++;
-				}
-
-				if (in_bfile_rack & in_bfile_mask) {
-					return_value |= mask;
-				}
-				mask >>= 1;
-				in_bfile_mask >>= 1;
-
-				if (in_bfile_mask == 0) {
-					in_bfile_mask = 0x80;
-				}
-			}
-			match_position = (int16_t) return_value;
-
-			if (match_position == LZSS_END_OF_STREAM) {
-				break;
-			}
+		error_if(header_size + offset > bytes_size, "Decompressed %s is truncated", name);
 
-			mask = 1L << (LZSS_LENGTH_BIT_COUNT - 1);
-			return_value = 0;
-			while (mask != 0) {
-				if (in_bfile_mask == 0x80) {
-					in_bfile_rack = (int16_t) * in_data++;
-				}
-
-				if (in_bfile_rack & in_bfile_mask) {
-					return_value |= mask;
-				}
-				mask >>= 1;
-				in_bfile_mask >>= 1;
-
-				if (in_bfile_mask == 0) {
-					in_bfile_mask = 0x80;
-				}
-			}
-			match_length = (int16_t) return_value;
-
-			match_length += LZSS_BREAK_EVEN;
-
-			for (i = 0 ; i <= match_length ; i++) {
-				cc = window[LZSS_MOD_WINDOW(match_position + i)];
-				*out_data++ = cc;
-				window[current_position] = cc;
-				current_position = LZSS_MOD_WINDOW(current_position + 1);
-			}
+		if (is_staged) {
+			stream_release(bytes);
 		}
+		mem_set_tag(mem_tag);
+		return cmp;
+	}
+	else if (is_staged) {
+		stream_release(bytes);
 	}
-}
 
-cmp_t *image_load_compressed(char *name) {
-	printf("load cmp %s\n", name);
 	uint32_t compressed_size;
-	uint8_t *compressed_bytes = file_load(name, &compressed_size);
+	uint8_t *compressed_bytes = file_map(name, &compressed_size);
 
 	uint32_t p = 0;
 	int32_t decompressed_size = 0;
@@ -251,53 +111,109 @@ cmp_t *image_load_compressed(char *name) {
 		offset += get_i32_le(compressed_bytes, &p);
 	}
 
-	lzss_decompress(compressed_bytes + p, decompressed_bytes);
-	mem_temp_free(compressed_bytes);
+	lzss_decompress(compressed_bytes + p, compressed_size - p, decompressed_bytes, decompressed_size);
+	file_unmap(compressed_bytes, compressed_size);
 
+	mem_set_tag(mem_tag);
 	return cmp;
 }
 
 uint16_t image_get_texture(char *name) {
 	printf("load: %s\n", name);
+	mem_tag_t mem_tag = mem_set_tag(MEM_TAG_TEXTURE);
 	uint32_t size;
-	uint8_t *bytes = file_load(name, &size);
+	uint8_t *bytes = file_map(name, &size);
 	image_t *image = image_load_from_bytes(bytes, false);
 	uint32_t texture_index = render_texture_create(image->width, image->height, image->pixels);
 	mem_temp_free(image);
-	mem_temp_free(bytes);
+	file_unmap(bytes, size);
 
+	mem_set_tag(mem_tag);
 	return texture_index;
 }
 
 uint16_t image_get_texture_semi_trans(char *name) {
 	printf("load: %s\n", name);
+	mem_tag_t mem_tag = mem_set_tag(MEM_TAG_TEXTURE);
 	uint32_t size;
-	uint8_t *bytes = file_load(name, &size);
+	uint8_t *bytes = file_map(name, &size);
 	image_t *image = image_load_from_bytes(bytes, true);
 	uint32_t texture_index = render_texture_create(image->width, image->height, image->pixels);
 	mem_temp_free(image);
-	mem_temp_free(bytes);
+	file_unmap(bytes, size);
 
+	mem_set_tag(mem_tag);
 	return texture_index;
 }
 
+// With a static hunk the pixels of a large cmp don't fit next to everything
+// else that is loaded; decode at most this many bytes at a time (but always at
+// least one image).
+#define IMAGE_DECODE_BATCH_BYTES (MEM_USE_VIRTUAL ? 0xffffffff : (256 * 1024))
+
+typedef struct {
+	cmp_t *cmp;
+	uint32_t first;
+	rgba_t **pixels;
+} image_decode_job_t;
+
+static void image_decode_job(void *data, uint32_t index) {
+	image_decode_job_t *job = data;
+	uint32_t i = job->first + index;
+	tim_decode(job->cmp->entries[i], false, job->pixels[i]);
+}
+
 texture_list_t image_get_compressed_textures(char *name) {
+	mem_tag_t mem_tag = mem_set_tag(MEM_TAG_TEXTURE);
 	cmp_t *cmp = image_load_compressed(name);
 	texture_list_t list = {.start = render_textures_len(), .len = cmp->len};
 
+	// Decode the images in parallel into one buffer, then create their
+	// textures at once, so that the renderer can pack them into the atlas by
+	// size. That's all images of the cmp, unless they exceed the batch size.
+	vec2i_t *sizes = mem_temp_alloc(sizeof(vec2i_t) * cmp->len);
+	rgba_t **pixels = mem_temp_alloc(sizeof(rgba_t *) * cmp->len);
 	for (int i = 0; i < cmp->len; i++) {
-		int32_t width, height;
-		image_t *image = image_load_from_bytes(cmp->entries[i], false);
+		sizes[i] = tim_size(cmp->entries[i]);
+	}
+
+	image_decode_job_t job = {.cmp = cmp, .pixels = pixels};
+	for (job.first = 0; job.first < cmp->len;) {
+		uint32_t batch_len = 0;
+		uint32_t pixels_len = 0;
+		while (job.first + batch_len < cmp->len) {
+			vec2i_t size = sizes[job.first + batch_len];
+			uint32_t image_len = size.x * size.y;
+			if (batch_len > 0 && (pixels_len + image_len) * sizeof(rgba_t) > IMAGE_DECODE_BATCH_BYTES) {
+				break;
+			}
+			pixels_len += image_len;
+			batch_len++;
+		}
+
+		rgba_t *batch_pixels = mem_temp_alloc(sizeof(rgba_t) * pixels_len);
+		for (int i = 0, offset = 0; i < batch_len; i++) {
+			pixels[job.first + i] = batch_pixels + offset;
+			offset += sizes[job.first + i].x * sizes[job.first + i].y;
+		}
+
+		jobs_run(image_decode_job, &job, batch_len);
 
-		// char png_name[1024] = {0};
-		// sprintf(png_name, "%s.%d.png", name, i);
-		// stbi_write_png(png_name, image->width, image->height, 4, image->pixels, 0);
+		// for (int i = job.first; i < job.first + batch_len; i++) {
+		// 	char png_name[1024] = {0};
+		// 	sprintf(png_name, "%s.%d.png", name, i);
+		// 	stbi_write_png(png_name, sizes[i].x, sizes[i].y, 4, pixels[i], 0);
+		// }
 
-		render_texture_create(image->width, image->height, image->pixels);
-		mem_temp_free(image);
+		render_textures_create(batch_len, sizes + job.first, pixels + job.first);
+		mem_temp_free(batch_pixels);
+		job.first += batch_len;
 	}
 
+	mem_temp_free(pixels);
+	mem_temp_free(sizes);
 	mem_temp_free(cmp);
+	mem_set_tag(mem_tag);
 	return list;
 }
 
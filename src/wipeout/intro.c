@@ -36,8 +36,10 @@ static void audio_mix(float *samples, uint32_t len);
 static void intro_end();
 
 void intro_init() {
+	mem_tag_t mem_tag = mem_set_tag(MEM_TAG_VIDEO);
 	plm = plm_create_with_filename("wipeout/intro.mpeg");
 	if (!plm) {
+		mem_set_tag(mem_tag);
 		intro_end();
 		return;
 	}
@@ -60,6 +62,7 @@ void intro_init() {
 	audio_buffer = mem_bump(INTRO_AUDIO_BUFFER_LEN * sizeof(float) * 2);
 	audio_buffer_read_pos = 0;
 	audio_buffer_write_pos = 0;
+	mem_set_tag(mem_tag);
 }
 
 static void intro_end() {
@@ -0,0 +1,99 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "lzss.h"
+
+#define LZSS_INDEX_BIT_COUNT  13
+#define LZSS_LENGTH_BIT_COUNT 4
+#define LZSS_WINDOW_SIZE      (1 << LZSS_INDEX_BIT_COUNT)
+#define LZSS_BREAK_EVEN       ((1 + LZSS_INDEX_BIT_COUNT + LZSS_LENGTH_BIT_COUNT) / 9)
+#define LZSS_END_OF_STREAM    0
+#define LZSS_MOD_WINDOW(a)    ((a) & (LZSS_WINDOW_SIZE - 1))
+
+// Bits are read msb first from a 64 bit buffer. A refill tops it up to more
+// than 32 bits, which covers the longest token (1 + 13 + 4 bits), so each
+// token needs only one refill. Past the end of the input, zeros are read.
+
+typedef struct {
+	uint64_t bits;
+	uint32_t len;
+	uint8_t *in;
+	uint8_t *in_end;
+} lzss_bits_t;
+
+static inline void lzss_refill(lzss_bits_t *b) {
+	if (b->len > 32) {
+		return;
+	}
+	if (b->in_end - b->in >= 4) {
+		uint32_t word = ((uint32_t)b->in[0] << 24) | (b->in[1] << 16) | (b->in[2] << 8) | b->in[3];
+		b->bits |= (uint64_t)word << (32 - b->len);
+		b->in += 4;
+		b->len += 32;
+	}
+	else {
+		while (b->len <= 56) {
+			uint8_t byte = b->in < b->in_end ? *b->in++ : 0;
+			b->bits |= (uint64_t)byte << (56 - b->len);
+			b->len += 8;
+		}
+	}
+}
+
+static inline uint32_t lzss_take(lzss_bits_t *b, uint32_t count) {
+	uint32_t v = b->bits >> (64 - count);
+	b->bits <<= count;
+	b->len -= count;
+	return v;
+}
+
+uint32_t lzss_decompress(uint8_t *in_data, uint32_t in_len, uint8_t *out_data, uint32_t out_len) {
+	lzss_bits_t b = {.bits = 0, .len = 0, .in = in_data, .in_end = in_data + in_len};
+	uint32_t out_pos = 0;
+
+	while (true) {
+		lzss_refill(&b);
+		if (lzss_take(&b, 1)) {
+			uint8_t cc = lzss_take(&b, 8);
+			if (out_pos == out_len) {
+				break;
+			}
+			out_data[out_pos++] = cc;
+			continue;
+		}
+
+		uint32_t match_position = lzss_take(&b, LZSS_INDEX_BIT_COUNT);
+		if (match_position == LZSS_END_OF_STREAM) {
+			break;
+		}
+		uint32_t match_length = lzss_take(&b, LZSS_LENGTH_BIT_COUNT) + LZSS_BREAK_EVEN + 1;
+		if (match_length > out_len - out_pos) {
+			match_length = out_len - out_pos;
+		}
+
+		// Output byte n sits at window position n + 1, so a match is just a
+		// copy from distance bytes back in the output. Matches may overlap
+		// themselves, which repeats the bytes between source and destination.
+		uint32_t distance = LZSS_MOD_WINDOW(out_pos - match_position) + 1;
+		uint8_t *dst = out_data + out_pos;
+		if (distance > out_pos) {
+			// Reaches before the start of the output, into a window that was
+			// never written. Valid streams don't do that; just write zeros.
+			for (uint32_t i = 0; i < match_length; i++) {
+				dst[i] = out_pos + i >= distance ? out_data[out_pos + i - distance] : 0;
+			}
+		}
+		else if (distance >= match_length) {
+			memcpy(dst, dst - distance, match_length);
+		}
+		else {
+			uint8_t *src = dst - distance;
+			for (uint32_t i = 0; i < match_length; i++) {
+				dst[i] = src[i];
+			}
+		}
+		out_pos += match_length;
+	}
+
+	return out_pos;
+}
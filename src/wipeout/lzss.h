@@ -0,0 +1,12 @@
+#ifndef LZSS_H
+#define LZSS_H
+
+#include <stdint.h>
+
+// Decompress an LZSS stream as found in .cmp files. The size of the output
+// is not part of the stream; it is taken from the .cmp header. Decoding
+// stops at the end of the stream or when out_len bytes are written; returns
+// the number of bytes written.
+uint32_t lzss_decompress(uint8_t *in_data, uint32_t in_len, uint8_t *out_data, uint32_t out_len);
+
+#endif
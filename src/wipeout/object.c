@@ -24,9 +24,35 @@ static rgba_t int32_to_rgba(uint32_t v) {
 	);
 }
 
+static void object_build_tris(Object *object, bool dynamic);
+
+// Ship engine primitives are moved every frame (see ship_update()), so they
+// are not part of the mesh, but built and pushed each time they are drawn
+static inline bool object_primitive_is_dynamic(Prm poly) {
+	return flags_is(poly.f3->flag, PRM_SHIP_ENGINE);
+}
+
+static inline Prm object_primitive_next(Prm poly) {
+	switch (poly.primitive->type) {
+	case PRM_TYPE_GT3: poly.gt3 += 1; break;
+	case PRM_TYPE_GT4: poly.gt4 += 1; break;
+	case PRM_TYPE_FT3: poly.ft3 += 1; break;
+	case PRM_TYPE_FT4: poly.ft4 += 1; break;
+	case PRM_TYPE_G3: poly.g3 += 1; break;
+	case PRM_TYPE_G4: poly.g4 += 1; break;
+	case PRM_TYPE_F3: poly.f3 += 1; break;
+	case PRM_TYPE_F4: poly.f4 += 1; break;
+	case PRM_TYPE_TSPR:
+	case PRM_TYPE_BSPR: poly.spr += 1; break;
+	default: break;
+	}
+	return poly;
+}
+
 Object *objects_load(char *name, texture_list_t tl) {
+	mem_tag_t mem_tag = mem_set_tag(MEM_TAG_MESH);
 	uint32_t length = 0;
-	uint8_t *bytes = file_load(name, &length);
+	uint8_t *bytes = file_map(name, &length);
 	if (!bytes) {
 		die("Failed to load file %s\n", name);
 	}
@@ -94,6 +120,7 @@ Object *objects_load(char *name, texture_list_t tl) {
 		}
 
 		object->primitives = mem_mark();
+		int32_t sprite_extent = 0;
 		for (int i = 0; i < object->primitives_len; i++) {
 			Prm prm;
 			int16_t prm_type = get_i16(bytes, &p);
@@ -442,26 +469,72 @@ Object *objects_load(char *name, texture_list_t tl) {
 
 			prm.f3->type = prm_type;
 			prm.f3->flag = prm_flag;
+
+			bool is_dynamic = object_primitive_is_dynamic(prm);
+			uint16_t *tris_len = is_dynamic ? &object->dynamic_tris_len : &object->tris_len;
+			uint16_t *quads_len = is_dynamic ? &object->dynamic_quads_len : &object->quads_len;
+			switch (prm_type) {
+			case PRM_TYPE_F3: case PRM_TYPE_FT3: case PRM_TYPE_G3: case PRM_TYPE_GT3:
+				*tris_len += 1;
+				break;
+			case PRM_TYPE_F4: case PRM_TYPE_FT4: case PRM_TYPE_G4: case PRM_TYPE_GT4:
+				*tris_len += 2;
+				*quads_len += 1;
+				break;
+			case PRM_TYPE_TSPR: case PRM_TYPE_BSPR:
+				object->sprites_len++;
+				sprite_extent = max(sprite_extent, max(prm.spr->width, prm.spr->height));
+				break;
+			}
+
+			if (flags_is(prm_flag, PRM_TRANSLUCENT)) {
+				object->is_translucent = true;
+			}
 		} // each prim
+
+		// Sprites are centered on a vertex, so growing the radius by their
+		// largest size covers any orientation
+		float radius_sq = 0;
+		for (int i = 0; i < object->vertices_len; i++) {
+			radius_sq = max(radius_sq, vec3_dot(object->vertices[i], object->vertices[i]));
+		}
+		object->radius = sqrt(radius_sq) + sprite_extent;
+
+		object->tris = mem_bump(object->tris_len * sizeof(tris_t));
+		object->tris_textures = mem_bump(object->tris_len * sizeof(uint16_t));
+		object->dynamic_tris = mem_bump(object->dynamic_tris_len * sizeof(tris_t));
+		object->dynamic_tris_textures = mem_bump(object->dynamic_tris_len * sizeof(uint16_t));
+		object_build_tris(object, false);
+		object->mesh = render_mesh_create(object->tris, object->tris_textures, object->tris_len, object->quads_len);
 	} // each object
 
-	mem_temp_free(bytes);
+	file_unmap(bytes, length);
+	mem_set_tag(mem_tag);
 	return objectList;
 }
 
 
-void object_draw(Object *object, mat4_t *mat) {
+// Build either the tris of the mesh or the dynamic tris, from the primitives
+// that belong to them
+static void object_build_tris(Object *object, bool dynamic) {
 	vec3_t *vertex = object->vertices;
 
+	// Quads are written to the start of the tris, everything else after them
+	tris_t *quads = dynamic ? object->dynamic_tris : object->tris;
+	uint16_t *quads_textures = dynamic ? object->dynamic_tris_textures : object->tris_textures;
+	uint16_t quads_len = dynamic ? object->dynamic_quads_len : object->quads_len;
+	tris_t *tris = quads + quads_len * 2;
+	uint16_t *tris_textures = quads_textures + quads_len * 2;
+
 	Prm poly = {.primitive = object->primitives};
 	int primitives_len = object->primitives_len;
 
-	render_set_model_mat(mat);
-	render_push_matrix();
-
-	// TODO: check for PRM_SINGLE_SIDED
-
 	for (int i = 0; i < primitives_len; i++) {
+		if (object_primitive_is_dynamic(poly) != dynamic) {
+			poly = object_primitive_next(poly);
+			continue;
+		}
+
 		int coord0;
 		int coord1;
 		int coord2;
@@ -472,7 +545,7 @@ void object_draw(Object *object, mat4_t *mat) {
 			coord1 = poly.gt3->coords[1];
 			coord2 = poly.gt3->coords[2];
 
-			render_push_tris((tris_t) {
+			*tris++ = (tris_t) {
 				.vertices = {
 					{
 						.pos = vertex[coord2],
@@ -490,7 +563,8 @@ void object_draw(Object *object, mat4_t *mat) {
 						.color = poly.gt3->colour[0]
 					},
 				}
-			}, poly.gt3->texture);
+			};
+			*tris_textures++ = poly.gt3->texture;
 
 			poly.gt3 += 1;
 			break;
@@ -501,7 +575,7 @@ void object_draw(Object *object, mat4_t *mat) {
 			coord2 = poly.gt4->coords[2];
 			coord3 = poly.gt4->coords[3];
 
-			render_push_tris((tris_t) {
+			*quads++ = (tris_t) {
 				.vertices = {
 					{
 						.pos = vertex[coord2],
@@ -519,8 +593,9 @@ void object_draw(Object *object, mat4_t *mat) {
 						.color = poly.gt4->colour[0]
 					},
 				}
-			}, poly.gt4->texture);
-			render_push_tris((tris_t) {
+			};
+			*quads_textures++ = poly.gt4->texture;
+			*quads++ = (tris_t) {
 				.vertices = {
 					{
 						.pos = vertex[coord2],
@@ -538,7 +613,8 @@ void object_draw(Object *object, mat4_t *mat) {
 						.color = poly.gt4->colour[1]
 					},
 				}
-			}, poly.gt4->texture);
+			};
+			*quads_textures++ = poly.gt4->texture;
 
 			poly.gt4 += 1;
 			break;
@@ -548,7 +624,7 @@ void object_draw(Object *object, mat4_t *mat) {
 			coord1 = poly.ft3->coords[1];
 			coord2 = poly.ft3->coords[2];
 
-			render_push_tris((tris_t) {
+			*tris++ = (tris_t) {
 				.vertices = {
 					{
 						.pos = vertex[coord2],
@@ -566,7 +642,8 @@ void object_draw(Object *object, mat4_t *mat) {
 						.color = poly.ft3->colour
 					},
 				}
-			}, poly.ft3->texture);
+			};
+			*tris_textures++ = poly.ft3->texture;
 
 			poly.ft3 += 1;
 			break;
@@ -577,7 +654,7 @@ void object_draw(Object *object, mat4_t *mat) {
 			coord2 = poly.ft4->coords[2];
 			coord3 = poly.ft4->coords[3];
 
-			render_push_tris((tris_t) {
+			*quads++ = (tris_t) {
 				.vertices = {
 					{
 						.pos = vertex[coord2],
@@ -595,8 +672,9 @@ void object_draw(Object *object, mat4_t *mat) {
 						.color = poly.ft4->colour
 					},
 				}
-			}, poly.ft4->texture);
-			render_push_tris((tris_t) {
+			};
+			*quads_textures++ = poly.ft4->texture;
+			*quads++ = (tris_t) {
 				.vertices = {
 					{
 						.pos = vertex[coord2],
@@ -614,7 +692,8 @@ void object_draw(Object *object, mat4_t *mat) {
 						.color = poly.ft4->colour
 					},
 				}
-			}, poly.ft4->texture);
+			};
+			*quads_textures++ = poly.ft4->texture;
 
 			poly.ft4 += 1;
 			break;
@@ -624,7 +703,7 @@ void object_draw(Object *object, mat4_t *mat) {
 			coord1 = poly.g3->coords[1];
 			coord2 = poly.g3->coords[2];
 
-			render_push_tris((tris_t) {
+			*tris++ = (tris_t) {
 				.vertices = {
 					{
 						.pos = vertex[coord2],
@@ -639,7 +718,8 @@ void object_draw(Object *object, mat4_t *mat) {
 						.color = poly.g3->colour[0]
 					},
 				}
-			}, RENDER_NO_TEXTURE);
+			};
+			*tris_textures++ = RENDER_NO_TEXTURE;
 
 			poly.g3 += 1;
 			break;
@@ -650,7 +730,7 @@ void object_draw(Object *object, mat4_t *mat) {
 			coord2 = poly.g4->coords[2];
 			coord3 = poly.g4->coords[3];
 
-			render_push_tris((tris_t) {
+			*quads++ = (tris_t) {
 				.vertices = {
 					{
 						.pos = vertex[coord2],
@@ -665,8 +745,9 @@ void object_draw(Object *object, mat4_t *mat) {
 						.color = poly.g4->colour[0]
 					},
 				}
-			}, RENDER_NO_TEXTURE);
-			render_push_tris((tris_t) {
+			};
+			*quads_textures++ = RENDER_NO_TEXTURE;
+			*quads++ = (tris_t) {
 				.vertices = {
 					{
 						.pos = vertex[coord2],
@@ -681,7 +762,8 @@ void object_draw(Object *object, mat4_t *mat) {
 						.color = poly.g4->colour[1]
 					},
 				}
-			}, RENDER_NO_TEXTURE);
+			};
+			*quads_textures++ = RENDER_NO_TEXTURE;
 
 			poly.g4 += 1;
 			break;
@@ -691,7 +773,7 @@ void object_draw(Object *object, mat4_t *mat) {
 			coord1 = poly.f3->coords[1];
 			coord2 = poly.f3->coords[2];
 
-			render_push_tris((tris_t) {
+			*tris++ = (tris_t) {
 				.vertices = {
 					{
 						.pos = vertex[coord2],
@@ -706,7 +788,8 @@ void object_draw(Object *object, mat4_t *mat) {
 						.color = poly.f3->colour
 					},
 				}
-			}, RENDER_NO_TEXTURE);
+			};
+			*tris_textures++ = RENDER_NO_TEXTURE;
 
 			poly.f3 += 1;
 			break;
@@ -717,7 +800,7 @@ void object_draw(Object *object, mat4_t *mat) {
 			coord2 = poly.f4->coords[2];
 			coord3 = poly.f4->coords[3];
 
-			render_push_tris((tris_t) {
+			*quads++ = (tris_t) {
 				.vertices = {
 					{
 						.pos = vertex[coord2],
@@ -732,8 +815,9 @@ void object_draw(Object *object, mat4_t *mat) {
 						.color = poly.f4->colour
 					},
 				}
-			}, RENDER_NO_TEXTURE);
-			render_push_tris((tris_t) {
+			};
+			*quads_textures++ = RENDER_NO_TEXTURE;
+			*quads++ = (tris_t) {
 				.vertices = {
 					{
 						.pos = vertex[coord2],
@@ -748,33 +832,92 @@ void object_draw(Object *object, mat4_t *mat) {
 						.color = poly.f4->colour
 					},
 				}
-			}, RENDER_NO_TEXTURE);
+			};
+			*quads_textures++ = RENDER_NO_TEXTURE;
 
 			poly.f4 += 1;
 			break;
 
 		case PRM_TYPE_TSPR:
 		case PRM_TYPE_BSPR:
-			coord0 = poly.spr->coord;
+			// Sprites are drawn separately in object_draw()
+			poly.spr += 1;
+			break;
+
+		default:
+			break;
+
+		}
+	}
+}
+
+void object_update_mesh(Object *object) {
+	object_build_tris(object, false);
+	render_mesh_update(object->mesh, 0, object->tris_len);
+}
+
+static void object_draw_sprites(Object *object) {
+	vec3_t *vertex = object->vertices;
+	Prm poly = {.primitive = object->primitives};
+	int primitives_len = object->primitives_len;
 
+	for (int i = 0; i < primitives_len; i++) {
+		if (poly.primitive->type == PRM_TYPE_TSPR || poly.primitive->type == PRM_TYPE_BSPR) {
 			render_push_sprite(
 				vec3(
-					vertex[coord0].x,
-					vertex[coord0].y + ((poly.primitive->type == PRM_TYPE_TSPR ? poly.spr->height : -poly.spr->height) >> 1),
-					vertex[coord0].z
+					vertex[poly.spr->coord].x,
+					vertex[poly.spr->coord].y + ((poly.primitive->type == PRM_TYPE_TSPR ? poly.spr->height : -poly.spr->height) >> 1),
+					vertex[poly.spr->coord].z
 				),
 				vec2i(poly.spr->width, poly.spr->height),
 				poly.spr->colour,
 				poly.spr->texture
 			);
+		}
+		poly = object_primitive_next(poly);
+	}
+}
 
-			poly.spr += 1;
-			break;
+void object_draw(Object *object, mat4_t *mat) {
+	render_set_model_mat(mat);
+	render_push_matrix();
 
-		default:
-			break;
+	// TODO: check for PRM_SINGLE_SIDED
+
+	render_mesh_draw(object->mesh, 0, object->tris_len);
+
+	if (object->dynamic_tris_len) {
+		object_build_tris(object, true);
+		for (int i = 0; i < object->dynamic_tris_len; i++) {
+			render_push_tris(object->dynamic_tris[i], object->dynamic_tris_textures[i]);
+		}
+	}
+
+	// Sprites always face the camera, so they can not be part of the mesh
+	if (object->sprites_len) {
+		object_draw_sprites(object);
+	}
+	render_pop_matrix();
+}
+
+void object_draw_dynamic(Object *object, mat4_t *mat) {
+	render_set_model_mat(mat);
+	render_push_matrix();
 
+	// The tris of the mesh are rebuilt, but not uploaded
+	for (int pass = 0; pass < 2; pass++) {
+		bool dynamic = pass;
+		object_build_tris(object, dynamic);
+		tris_t *tris = dynamic ? object->dynamic_tris : object->tris;
+		uint16_t *textures = dynamic ? object->dynamic_tris_textures : object->tris_textures;
+		uint16_t tris_len = dynamic ? object->dynamic_tris_len : object->tris_len;
+		for (int i = 0; i < tris_len; i++) {
+			render_push_tris(tris[i], textures[i]);
 		}
 	}
+
+	if (object->sprites_len) {
+		object_draw_sprites(object);
+	}
 	render_pop_matrix();
 }
@@ -340,8 +340,21 @@ typedef struct Object {
 	int16_t primitives_len; // Number of Primitives
 	Primitive *primitives; // Pointer to Z Sort Primitives
 
+	uint16_t mesh; // Render mesh of all primitives except sprites and engines
+	uint16_t tris_len;
+	uint16_t quads_len; // Quads come first in tris, 2 tris each
+	uint16_t sprites_len;
+	tris_t *tris;
+	uint16_t *tris_textures;
+	uint16_t dynamic_tris_len; // Ship engines, built each time they are drawn
+	uint16_t dynamic_quads_len;
+	tris_t *dynamic_tris;
+	uint16_t *dynamic_tris_textures;
+
 	vec3_t origin;
 	int32_t extent; // Flags for object characteristics
+	float radius; // Bounding sphere around the local origin, incl. sprites and ship exhaust plumes
+	bool is_translucent; // Any primitive has PRM_TRANSLUCENT
 	int16_t flags; // Next object in list
 	struct Object *next; // Next object in list
 } Object;
@@ -380,4 +393,12 @@ typedef union Prm {
 Object *objects_load(char *name, texture_list_t tl);
 void object_draw(Object *object, mat4_t *mat);
 
+// Draw all primitives as they are now, without the mesh. For models that are
+// shared by several instances with different colors, like mines and shields.
+void object_draw_dynamic(Object *object, mat4_t *mat);
+
+// Must be called after changing the colors or vertices of the object's
+// primitives, so that they show up in the render mesh.
+void object_update_mesh(Object *object);
+
 #endif
\ No newline at end of file
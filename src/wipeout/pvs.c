@@ -0,0 +1,84 @@
+#include "../mem.h"
+#include "../render.h"
+#include "../utils.h"
+
+#include "track.h"
+#include "camera.h"
+#include "game.h"
+#include "pvs.h"
+
+// The region a camera that uses the set of a section may be in: the bounds
+// of its tris and its center, grown by PVS_CAMERA_MARGIN
+static void pvs_camera_region(section_t *s, vec3_t *region_min, vec3_t *region_max) {
+	vec3_t margin = vec3(PVS_CAMERA_MARGIN, PVS_CAMERA_MARGIN, PVS_CAMERA_MARGIN);
+	vec3_t bmin = vec3(min(s->bounds_min.x, s->center.x), min(s->bounds_min.y, s->center.y), min(s->bounds_min.z, s->center.z));
+	vec3_t bmax = vec3(max(s->bounds_max.x, s->center.x), max(s->bounds_max.y, s->center.y), max(s->bounds_max.z, s->center.z));
+	*region_min = vec3_sub(bmin, margin);
+	*region_max = vec3_add(bmax, margin);
+}
+
+static float pvs_gap_sq(vec3_t amin, vec3_t amax, vec3_t bmin, vec3_t bmax) {
+	vec3_t gap = vec3(
+		max(0, max(amin.x - bmax.x, bmin.x - amax.x)),
+		max(0, max(amin.y - bmax.y, bmin.y - amax.y)),
+		max(0, max(amin.z - bmax.z, bmin.z - amax.z))
+	);
+	return vec3_dot(gap, gap);
+}
+
+void pvs_build(pvs_t *pvs, vec3_t *items_min, vec3_t *items_max, uint32_t len) {
+	pvs->len = len;
+	pvs->words_len = (len + 31) / 32;
+	pvs->bits = mem_bump(g.track.section_count * pvs->words_len * sizeof(uint32_t));
+
+	float max_dist_sq = RENDER_FADEOUT_FAR * RENDER_FADEOUT_FAR;
+	for (int i = 0; i < g.track.section_count; i++) {
+		vec3_t region_min, region_max;
+		pvs_camera_region(&g.track.sections[i], &region_min, &region_max);
+
+		uint32_t *set = pvs->bits + i * pvs->words_len;
+		for (uint32_t j = 0; j < len; j++) {
+			if (pvs_gap_sq(region_min, region_max, items_min[j], items_max[j]) < max_dist_sq) {
+				set[j / 32] |= 1u << (j % 32);
+			}
+		}
+	}
+}
+
+uint32_t *pvs_for_camera(pvs_t *pvs, camera_t *camera) {
+	section_t *s = camera->section;
+	if (!pvs->bits || !s) {
+		return NULL;
+	}
+
+	vec3_t region_min, region_max;
+	pvs_camera_region(s, &region_min, &region_max);
+	vec3_t p = camera->position;
+	if (
+		p.x < region_min.x || p.y < region_min.y || p.z < region_min.z ||
+		p.x > region_max.x || p.y > region_max.y || p.z > region_max.z
+	) {
+		return NULL;
+	}
+	return pvs->bits + (s - g.track.sections) * pvs->words_len;
+}
+
+int32_t pvs_next(pvs_t *pvs, uint32_t *set, int32_t index) {
+	if ((uint32_t)index >= pvs->len) {
+		return -1;
+	}
+	if (!set) {
+		return index;
+	}
+
+	uint32_t word = index / 32;
+	uint32_t bits = set[word] & (~0u << (index % 32));
+	while (!bits) {
+		word++;
+		if (word >= pvs->words_len) {
+			return -1;
+		}
+		bits = set[word];
+	}
+	return word * 32 + __builtin_ctz(bits);
+}
@@ -0,0 +1,36 @@
+#ifndef PVS_H
+#define PVS_H
+
+#include "../types.h"
+
+// Potentially visible sets: for each track section, a bitset of all items
+// (sections or scene objects) that may be within the fadeout distance of a
+// camera near that section. These are built at load time and only replace
+// the distance test; the frustum tests still apply to each item in a set.
+
+// How far the camera may be outside of the bounds of its section for the
+// set of that section to be used. Cameras further away fall back to testing
+// all items.
+#define PVS_CAMERA_MARGIN 2048.0
+
+typedef struct {
+	uint32_t *bits;
+	uint32_t words_len; // per set
+	uint32_t len; // items per set
+} pvs_t;
+
+struct camera_t;
+
+// Build a set for each of g.track.sections over the items with the given
+// bounding boxes. Allocated on the hunk.
+void pvs_build(pvs_t *pvs, vec3_t *items_min, vec3_t *items_max, uint32_t len);
+
+// The set for the camera's current section, or NULL if the camera is too
+// far outside of it
+uint32_t *pvs_for_camera(pvs_t *pvs, struct camera_t *camera);
+
+// The first index >= index in set, or -1 if there is none. A NULL set
+// contains all indices.
+int32_t pvs_next(pvs_t *pvs, uint32_t *set, int32_t index);
+
+#endif
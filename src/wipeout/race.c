@@ -3,6 +3,9 @@
 #include "../platform.h"
 #include "../system.h"
 #include "../utils.h"
+#include "../profiler.h"
+#include "../pak.h"
+#include "../stream.h"
 
 #include "object.h"
 #include "track.h"
@@ -20,6 +23,8 @@
 #include "menu.h"
 #include "ship_ai.h"
 #include "ingame_menus.h"
+#include "visibility.h"
+#include "ui.h"
 
 #define ATTRACT_DURATION 60.0
 
@@ -29,18 +34,99 @@ static bool has_show_credits = false;
 static float attract_start_time;
 static menu_t *active_menu = NULL;
 
+// Races are loaded in steps, one per frame, while a loading screen is drawn.
+// The files of all steps are queued for the loader thread up front; a step
+// only runs once its files are read, so the frame never waits on the disk.
+typedef enum {
+	RACE_LOAD_TRACK_TEXTURES,
+	RACE_LOAD_TRACK_GEOMETRY,
+	RACE_LOAD_SCENE,
+	RACE_LOAD_START,
+	RACE_LOAD_DONE,
+} race_load_step_t;
+
+static char *race_load_files[RACE_LOAD_DONE][4] = {
+	[RACE_LOAD_TRACK_TEXTURES] = {"library.ttf", "library.cmp"},
+	[RACE_LOAD_TRACK_GEOMETRY] = {"track.trv", "track.trf", "track.trs"},
+	[RACE_LOAD_SCENE] = {"scene.cmp", "scene.prm", "sky.cmp", "sky.prm"},
+};
+
+static race_load_step_t load_step = RACE_LOAD_DONE;
+
+static void race_load_finish();
+
+// The archive of the track of the current race; replaced when a race on a
+// different track starts, so that only one track archive is mounted at a time
+static char track_pak_path[PAK_PATH_LEN] = "";
+
 void race_init() {
 	ingame_menus_load();
 	menu_is_scroll_text = false;
+	is_paused = false;
 
 	const circut_settings_t *cs = &def.circuts[g.circut].settings[g.race_class];
-	track_load(cs->path);
-	scene_load(cs->path, cs->sky_y_offset);
-	
-	if (g.circut == CIRCUT_SILVERSTREAM && g.race_class == RACE_CLASS_RAPIER) {
-		scene_init_aurora_borealis();	
-	} 
 
+	// wipeout/track01/ is packed into wipeout/track01.pak
+	char pak_path[PAK_PATH_LEN];
+	snprintf(pak_path, sizeof(pak_path), "%.*s.pak", (int)strlen(cs->path) - 1, cs->path);
+	if (strcmp(pak_path, track_pak_path) != 0) {
+		pak_unmount(track_pak_path);
+		strcpy(track_pak_path, pak_path);
+	}
+	pak_mount(pak_path);
+
+	for (int step = 0; step < RACE_LOAD_DONE; step++) {
+		for (int i = 0; i < len(race_load_files[step]) && race_load_files[step][i]; i++) {
+			stream_prefetch(get_path(cs->path, race_load_files[step][i]));
+		}
+	}
+	load_step = RACE_LOAD_TRACK_TEXTURES;
+}
+
+bool race_is_loading() {
+	return load_step != RACE_LOAD_DONE;
+}
+
+static void race_load_step() {
+	const circut_settings_t *cs = &def.circuts[g.circut].settings[g.race_class];
+	for (int i = 0; i < len(race_load_files[load_step]) && race_load_files[load_step][i]; i++) {
+		if (!stream_is_ready(get_path(cs->path, race_load_files[load_step][i]))) {
+			return;
+		}
+	}
+
+	switch (load_step) {
+		case RACE_LOAD_TRACK_TEXTURES:
+			track_load_textures(cs->path);
+			break;
+		case RACE_LOAD_TRACK_GEOMETRY:
+			track_load_geometry(cs->path);
+			break;
+		case RACE_LOAD_SCENE:
+			scene_load(cs->path, cs->sky_y_offset);
+			if (g.circut == CIRCUT_SILVERSTREAM && g.race_class == RACE_CLASS_RAPIER) {
+				scene_init_aurora_borealis();
+			}
+			break;
+		case RACE_LOAD_START:
+			race_load_finish();
+			break;
+		default:
+			break;
+	}
+	load_step++;
+}
+
+static void race_draw_loading() {
+	render_set_view_2d();
+	ui_draw_text_centered("LOADING", ui_scaled_pos(UI_POS_MIDDLE | UI_POS_CENTER, vec2i(0, -8)), UI_SIZE_16, UI_COLOR_DEFAULT);
+
+	vec2i_t bar_pos = ui_scaled_pos(UI_POS_MIDDLE | UI_POS_CENTER, vec2i(-64, 16));
+	vec2i_t bar_size = ui_scaled(vec2i(128 * load_step / RACE_LOAD_DONE, 2));
+	render_push_2d(bar_pos, bar_size, UI_COLOR_ACCENT, RENDER_NO_TEXTURE);
+}
+
+static void race_load_finish() {
 	race_start();
 	// render_textures_dump("texture_atlas.png");
 
@@ -64,10 +150,18 @@ void race_init() {
 		}
 	}
 
-	is_paused = false;
+	system_reset_cycle_time();
 }
 
 void race_update() {
+	if (race_is_loading()) {
+		race_load_step();
+		if (race_is_loading()) {
+			race_draw_loading();
+			return;
+		}
+	}
+
 	if (is_paused) {
 		if (!active_menu) {
 			active_menu = pause_menu_init();
@@ -77,11 +171,17 @@ void race_update() {
 		}
 	}
 	else {
+		profiler_begin(PROFILER_ZONE_SHIPS_UPDATE);
 		ships_update();
+		profiler_end(PROFILER_ZONE_SHIPS_UPDATE);
 		droid_update(&g.droid, &g.ships[g.pilot]);
 		camera_update(&g.camera, &g.ships[g.pilot], &g.droid);
+		profiler_begin(PROFILER_ZONE_WEAPONS_UPDATE);
 		weapons_update();
+		profiler_end(PROFILER_ZONE_WEAPONS_UPDATE);
+		profiler_begin(PROFILER_ZONE_PARTICLES_UPDATE);
 		particles_update();
+		profiler_end(PROFILER_ZONE_PARTICLES_UPDATE);
 		scene_update();
 		if (g.race_type != RACE_TYPE_TIME_TRIAL) {
 			track_cycle_pickups();
@@ -104,10 +204,15 @@ void race_update() {
 
 	// Draw 3D
 	render_set_view(g.camera.position, g.camera.angle);
+	visibility_begin(&g.camera);
 
 	render_set_cull_backface(false);
+	profiler_begin(PROFILER_ZONE_SCENE_DRAW);
 	scene_draw(&g.camera);	
+	profiler_end(PROFILER_ZONE_SCENE_DRAW);
+	profiler_begin(PROFILER_ZONE_TRACK_DRAW);
 	track_draw(&g.camera);
+	profiler_end(PROFILER_ZONE_TRACK_DRAW);
 	render_set_cull_backface(true);
 
 	ships_draw();
@@ -1,7 +1,10 @@
 #ifndef RACE_H
 #define RACE_H
 
+#include "../types.h"
+
 void race_init();
+bool race_is_loading();
 void race_update();
 void race_start();
 void race_restart();
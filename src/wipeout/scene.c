@@ -11,6 +11,8 @@
 #include "camera.h"
 #include "object.h"
 #include "game.h"
+#include "visibility.h"
+#include "pvs.h"
 
 
 #define SCENE_START_BOOMS_MAX 4
@@ -19,6 +21,9 @@
 #define SCENE_STANDS_MAX 20
 
 static Object *scene_objects;
+static Object **scene_objects_by_index;
+static uint32_t scene_objects_len;
+static pvs_t scene_objects_pvs;
 static Object *sky_object;
 static vec3_t sky_offset;
 
@@ -62,10 +67,12 @@ void scene_load(const char *base_path, float sky_y_offset) {
 	oil_pumps_len = 0;
 	red_lights_len = 0;
 	stands_len = 0;
+	scene_objects_len = 0;
 
 	Object *obj = scene_objects;
 	while (obj) {
 		mat4_set_translation(&obj->mat, obj->origin);
+		scene_objects_len++;
 
 		if (str_starts_with(obj->name, "start")) {
 			error_if(start_booms_len >= SCENE_START_BOOMS_MAX, "SCENE_START_BOOMS_MAX reached");
@@ -90,6 +97,22 @@ void scene_load(const char *base_path, float sky_y_offset) {
 		obj = obj->next;
 	}
 
+	// Potentially visible objects for each track section; the bounds of
+	// each are those of its bounding sphere
+	scene_objects_by_index = mem_bump(sizeof(Object *) * scene_objects_len);
+	vec3_t *objects_min = mem_temp_alloc(sizeof(vec3_t) * scene_objects_len);
+	vec3_t *objects_max = mem_temp_alloc(sizeof(vec3_t) * scene_objects_len);
+	obj = scene_objects;
+	for (int i = 0; i < scene_objects_len; i++, obj = obj->next) {
+		vec3_t radius = vec3(obj->radius, obj->radius, obj->radius);
+		scene_objects_by_index[i] = obj;
+		objects_min[i] = vec3_sub(obj->origin, radius);
+		objects_max[i] = vec3_add(obj->origin, radius);
+	}
+	pvs_build(&scene_objects_pvs, objects_min, objects_max, scene_objects_len);
+	mem_temp_free(objects_max);
+	mem_temp_free(objects_min);
+
 	aurora_borealis.enabled = false;
 }
 
@@ -124,20 +147,8 @@ void scene_draw(camera_t *camera) {
 	render_set_depth_write(true);
 
 	// Nearby objects
-	vec3_t cam_pos = camera->position;
-	Object *object = scene_objects;
-	float max_dist_sq = RENDER_FADEOUT_FAR * RENDER_FADEOUT_FAR;
-	while (object) {
-		vec3_t d = vec3_sub(cam_pos, object->origin);
-		float dist_sq = d.x * d.x + d.y * d.y + d.z * d.z;
-
-		if (dist_sq < max_dist_sq) {
-			object_draw(object, &object->mat);
-		}
-		
-		object = object->next;
-	}
-
+	uint32_t *pvs = pvs_for_camera(&scene_objects_pvs, camera);
+	visibility_draw_objects(scene_objects_by_index, &scene_objects_pvs, pvs);
 }
 
 void scene_set_start_booms(int light_index) {
@@ -174,6 +185,7 @@ void scene_set_start_booms(int light_index) {
 			}
 			libPoly.gt4 += 1;
 		}
+		object_update_mesh(start_booms[i]);
 	}
 }
 
@@ -187,6 +199,7 @@ void scene_pulsate_red_light(Object *obj) {
 		libPoly.gt4->colour[v].as_rgba.g = 0x00;
 		libPoly.gt4->colour[v].as_rgba.b = 0x00;
 	}
+	object_update_mesh(obj);
 }
 
 void scene_move_oil_pump(Object *pump) {
@@ -258,4 +271,5 @@ void scene_update_aurora_borealis() {
 			aurora_borealis.primitives[i]->colour[3].as_rgba.b = (sin(coords[3] * (phase + 0.039)) * 64.0) + 190;
 		}
 	}
+	object_update_mesh(sky_object);
 }
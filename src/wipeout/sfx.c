@@ -1,6 +1,7 @@
 #include "../utils.h"
 #include "../mem.h"
 #include "../platform.h"
+#include "../profiler.h"
 
 #include "sfx.h"
 #include "game.h"
@@ -51,6 +52,8 @@ static music_decoder_t *music;
 static void (*external_mix_cb)(float *, uint32_t len) = NULL;
 
 void sfx_load() {
+	mem_tag_t mem_tag = mem_set_tag(MEM_TAG_AUDIO);
+
 	// Init decode buffer for music
 	uint32_t channels = 2;
 	music = mem_bump(sizeof(music_decoder_t));
@@ -67,7 +70,7 @@ void sfx_load() {
 
 	// 16 byte blocks: 2 byte header, 14 bytes with 2x4bit samples each
 	uint32_t vb_size;
-	uint8_t *vb = file_load("wipeout/sound/wipeout.vb", &vb_size);
+	uint8_t *vb = file_map("wipeout/sound/wipeout.vb", &vb_size);
 	uint32_t num_samples = (vb_size / 16) * 28;
 
 	int16_t *sample_buffer = mem_bump(num_samples * sizeof(int16_t));
@@ -114,8 +117,9 @@ void sfx_load() {
 		}
 	}
 
-	mem_temp_free(vb);
+	file_unmap(vb, vb_size);
 	platform_set_audio_mix_cb(sfx_stero_mix);
+	mem_set_tag(mem_tag);
 }
 
 void sfx_reset() {
@@ -312,8 +316,10 @@ void sfx_set_external_mix_cb(void (*cb)(float *, uint32_t len)) {
 }
 
 void sfx_stero_mix(float *buffer, uint32_t len) {
+	profiler_begin(PROFILER_ZONE_AUDIO_MIX);
 	if (external_mix_cb) {
 		external_mix_cb(buffer, len);
+		profiler_end(PROFILER_ZONE_AUDIO_MIX);
 		return;
 	}
 
@@ -390,4 +396,5 @@ void sfx_stero_mix(float *buffer, uint32_t len) {
 		buffer[i+0] = left;
 		buffer[i+1] = right;
 	}
+	profiler_end(PROFILER_ZONE_AUDIO_MIX);
 }
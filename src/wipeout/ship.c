@@ -15,6 +15,7 @@
 #include "game.h"
 #include "race.h"
 #include "sfx.h"
+#include "visibility.h"
 
 void ships_load() {
 	texture_list_t ship_textures = image_get_compressed_textures("wipeout/common/allsh.cmp");
@@ -150,7 +151,8 @@ void ships_draw() {
 	for (int i = 0; i < len(g.ships); i++) {
 		if (
 			flags_is(g.ships[i].flags, SHIP_VIEW_INTERNAL) ||
-			(g.race_type == RACE_TYPE_TIME_TRIAL && i != g.pilot)
+			(g.race_type == RACE_TYPE_TIME_TRIAL && i != g.pilot) ||
+			!visibility_object_visible(g.ships[i].model, &g.ships[i].mat)
 		) {
 			continue;
 		}
@@ -525,11 +527,16 @@ void ship_update(ship_t *self) {
 		exhaust_len = 150;
 	}
 
+	// The engine primitives are not part of the mesh and are rebuilt from the
+	// vertices each time the ship is drawn. The plume can reach past the
+	// bounding sphere from load time; grow it, so that a ship just out of
+	// view isn't culled while its plume is still on screen.
 	for (int i = 0; i < 3; i++) {
 		if (self->exhaust_plume[i].v != NULL) {
 			self->exhaust_plume[i].v->z = self->exhaust_plume[i].initial.z - exhaust_len + (rand_int(-16383, 16383) >> 9);
 			self->exhaust_plume[i].v->x = self->exhaust_plume[i].initial.x + (rand_int(-16383, 16383) >> 11);
 			self->exhaust_plume[i].v->y = self->exhaust_plume[i].initial.y + (rand_int(-16383, 16383) >> 11);
+			self->model->radius = max(self->model->radius, vec3_len(*self->exhaust_plume[i].v));
 		}
 	}
 
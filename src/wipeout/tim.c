@@ -0,0 +1,157 @@
+#include "../utils.h"
+
+#include "tim.h"
+
+#define TIM_TYPE_PALETTED_4_BPP 0x08
+#define TIM_TYPE_PALETTED_8_BPP 0x09
+#define TIM_TYPE_TRUE_COLOR_16_BPP 0x02
+
+// The true color path converts 4 pixels at a time with SSE2 or NEON, through
+// the gcc vector extensions. Build with TIM_USE_SIMD=0 to always use the
+// scalar version.
+#if !defined(TIM_USE_SIMD)
+	#if (defined(__SSE2__) || defined(__ARM_NEON)) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		#define TIM_USE_SIMD 1
+	#else
+		#define TIM_USE_SIMD 0
+	#endif
+#endif
+
+typedef struct {
+	uint32_t type;
+	uint16_t *palette;
+	uint32_t palette_colors;
+	int32_t width;
+	int32_t height;
+	int32_t entries;
+	uint32_t data_pos;
+} tim_header_t;
+
+static inline rgba_t tim_16bit_to_rgba(uint16_t c, bool transparent_bit) {
+	return rgba(
+		((c >>  0) & 0x1f) << 3,
+		((c >>  5) & 0x1f) << 3,
+		((c >> 10) & 0x1f) << 3,
+		(c == 0 
+			? 0x00
+			: transparent_bit && (c & 0x7fff) == 0 ? 0x00 : 0xff
+		)
+	);
+}
+
+static tim_header_t tim_read_header(uint8_t *bytes) {
+	tim_header_t tim = {.palette = NULL, .palette_colors = 0};
+	uint32_t p = 0;
+
+	uint32_t magic = get_i32_le(bytes, &p);
+	tim.type = get_i32_le(bytes, &p);
+
+	if (
+		tim.type == TIM_TYPE_PALETTED_4_BPP ||
+		tim.type == TIM_TYPE_PALETTED_8_BPP
+	) {
+		uint32_t header_length = get_i32_le(bytes, &p);
+		uint16_t palette_x = get_i16_le(bytes, &p);
+		uint16_t palette_y = get_i16_le(bytes, &p);
+		tim.palette_colors = get_i16_le(bytes, &p);
+		uint16_t palettes = get_i16_le(bytes, &p);
+		tim.palette = (uint16_t *)(bytes + p);
+		p += tim.palette_colors * 2;
+	}
+
+	uint32_t data_size = get_i32_le(bytes, &p);
+
+	int32_t pixels_per_16bit = 1;
+	if (tim.type == TIM_TYPE_PALETTED_8_BPP) {
+		pixels_per_16bit = 2;
+	}
+	else if (tim.type == TIM_TYPE_PALETTED_4_BPP) {
+		pixels_per_16bit = 4;
+	}
+
+	uint16_t skip_x = get_i16_le(bytes, &p);
+	uint16_t skip_y = get_i16_le(bytes, &p);
+	uint16_t entries_per_row  = get_i16_le(bytes, &p);
+	uint16_t rows = get_i16_le(bytes, &p);
+
+	tim.width = entries_per_row * pixels_per_16bit;
+	tim.height = rows;
+	tim.entries = entries_per_row * rows;
+	tim.data_pos = p;
+	return tim;
+}
+
+vec2i_t tim_size(uint8_t *bytes) {
+	tim_header_t tim = tim_read_header(bytes);
+	return vec2i(tim.width, tim.height);
+}
+
+// Expand the palette to rgba once, instead of for every pixel. Indices past
+// the palette colors read on into the image data, same as they always did;
+// only entries that lie within the image are expanded, the rest are 0.
+static void tim_expand_palette(tim_header_t *tim, bool transparent, rgba_t *expanded, uint32_t len) {
+	uint32_t readable = tim->palette_colors + 6 + tim->entries; // palette, data header, data
+	for (uint32_t i = 0; i < len; i++) {
+		expanded[i] = i < readable
+			? tim_16bit_to_rgba(tim->palette[i], transparent)
+			: rgba(0, 0, 0, 0);
+	}
+}
+
+static void tim_decode_true_color(uint8_t *data, int32_t len, bool transparent, rgba_t *pixels) {
+	int32_t i = 0;
+
+	#if TIM_USE_SIMD
+		typedef uint16_t u16x4 __attribute__((vector_size(8)));
+		typedef uint32_t u32x4 __attribute__((vector_size(16)));
+
+		u32x4 transparent_mask = (u32x4){0} + (transparent ? 0xffffffff : 0);
+		for (; i + 4 <= len; i += 4) {
+			u16x4 c16;
+			memcpy(&c16, data + i * 2, sizeof(c16));
+			u32x4 c = __builtin_convertvector(c16, u32x4);
+			u32x4 rgb = 
+				((c & 0x1f) << 3) |
+				(((c >> 5) & 0x1f) << 11) |
+				(((c >> 10) & 0x1f) << 19);
+			u32x4 is_clear = (u32x4)(c == 0) | ((u32x4)((c & 0x7fff) == 0) & transparent_mask);
+			u32x4 out = rgb | (~is_clear & 0xff000000);
+			memcpy(pixels + i, &out, sizeof(out));
+		}
+	#endif
+
+	uint32_t p = i * 2;
+	for (; i < len; i++) {
+		pixels[i] = tim_16bit_to_rgba(get_i16_le(data, &p), transparent);
+	}
+}
+
+void tim_decode(uint8_t *bytes, bool transparent, rgba_t *pixels) {
+	tim_header_t tim = tim_read_header(bytes);
+	uint32_t p = tim.data_pos;
+	int32_t pixel_pos = 0;
+
+	if (tim.type == TIM_TYPE_TRUE_COLOR_16_BPP) {
+		tim_decode_true_color(bytes + p, tim.entries, transparent, pixels);
+	}
+	else if (tim.type == TIM_TYPE_PALETTED_8_BPP) {
+		rgba_t palette[256];
+		tim_expand_palette(&tim, transparent, palette, 256);
+		for (int i = 0; i < tim.entries; i++) {
+			int32_t palette_pos = get_i16_le(bytes, &p);
+			pixels[pixel_pos++] = palette[(palette_pos >> 0) & 0xff];
+			pixels[pixel_pos++] = palette[(palette_pos >> 8) & 0xff];
+		}
+	}
+	else if (tim.type == TIM_TYPE_PALETTED_4_BPP) {
+		rgba_t palette[16];
+		tim_expand_palette(&tim, transparent, palette, 16);
+		for (int i = 0; i < tim.entries; i++) {
+			int32_t palette_pos = get_i16_le(bytes, &p);
+			pixels[pixel_pos++] = palette[(palette_pos >>  0) & 0xf];
+			pixels[pixel_pos++] = palette[(palette_pos >>  4) & 0xf];
+			pixels[pixel_pos++] = palette[(palette_pos >>  8) & 0xf];
+			pixels[pixel_pos++] = palette[(palette_pos >> 12) & 0xf];
+		}
+	}
+}
@@ -0,0 +1,15 @@
+#ifndef TIM_H
+#define TIM_H
+
+#include "../types.h"
+
+// Decoding of PSX TIM images (4 and 8 bit paletted, 16 bit true color) to
+// rgba. Nothing here allocates, so it's safe to use from jobs.
+
+vec2i_t tim_size(uint8_t *bytes);
+
+// pixels must have room for tim_size().x * tim_size().y pixels. With
+// transparent, black pixels that have the stp bit set are transparent too.
+void tim_decode(uint8_t *bytes, bool transparent, rgba_t *pixels);
+
+#endif
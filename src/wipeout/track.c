@@ -2,39 +2,76 @@
 #include "../utils.h"
 #include "../render.h"
 #include "../system.h"
+#include "../jobs.h"
 
 #include "object.h"
 #include "track.h"
+#include "tim.h"
 #include "camera.h"
 #include "object.h"
 #include "game.h"
 
-void track_load(const char *base_path) {
-	// Load and assemble high res track tiles
+typedef struct {
+	ttf_t *ttf;
+	cmp_t *cmp;
+	uint32_t first_tile;
+	rgba_t *pixels;
+} track_tiles_job_t;
+
+// Assemble one 128x128 tile from its 16 32x32 sub tiles. Sub tiles are
+// decoded into scratch memory, which is reset after each job.
+static void track_tile_job(void *data, uint32_t index) {
+	track_tiles_job_t *job = data;
+	ttf_tile_t *tile = &job->ttf->tiles[job->first_tile + index];
+	image_t dst = {.width = 128, .height = 128, .pixels = job->pixels + index * 128 * 128};
+
+	for (int tx = 0; tx < 4; tx++) {
+		for (int ty = 0; ty < 4; ty++) {
+			uint8_t *bytes = job->cmp->entries[tile->near[ty * 4 + tx]];
+			vec2i_t size = tim_size(bytes);
+			image_t sub_tile = {.width = size.x, .height = size.y, .pixels = mem_scratch_alloc(size.x * size.y * sizeof(rgba_t))};
+			tim_decode(bytes, false, sub_tile.pixels);
+			image_copy(&sub_tile, &dst, 0, 0, 32, 32, tx * 32, ty * 32);
+		}
+	}
+}
+
+void track_load_textures(const char *base_path) {
+	mem_tag_t mem_tag = mem_set_tag(MEM_TAG_TRACK);
+
+	// Load and assemble high res track tiles. Tiles are assembled in parallel,
+	// a batch at a time, and then uploaded in order. Batches are only as large
+	// as needed to keep all threads busy; without threads it's one tile.
 
 	g.track.textures.start = render_textures_len();
 	g.track.textures.len = 0;
 
+	uint32_t temp_frame = mem_temp_frame_begin();
 	ttf_t *ttf = track_load_tile_format(get_path(base_path, "library.ttf"));
 	cmp_t *cmp = image_load_compressed(get_path(base_path, "library.cmp"));
 
-	image_t *temp_tile = image_alloc(128, 128);
-	for (int i = 0; i < ttf->len; i++) {
-		for (int tx = 0; tx < 4; tx++) {
-			for (int ty = 0; ty < 4; ty++) {
-				uint32_t sub_tile_index = ttf->tiles[i].near[ty * 4 + tx];
-				image_t *sub_tile = image_load_from_bytes(cmp->entries[sub_tile_index], false);
-				image_copy(sub_tile, temp_tile, 0, 0, 32, 32, tx * 32, ty * 32);
-				mem_temp_free(sub_tile);
-			}
+	uint32_t threads_len = jobs_threads_len();
+	uint32_t batch_max = threads_len > 0 ? (threads_len + 1) * TRACK_TILES_PER_THREAD : 1;
+	track_tiles_job_t job = {
+		.ttf = ttf,
+		.cmp = cmp,
+		.pixels = mem_temp_alloc(batch_max * 128 * 128 * sizeof(rgba_t))
+	};
+	for (job.first_tile = 0; job.first_tile < ttf->len; job.first_tile += batch_max) {
+		uint32_t batch_len = min(ttf->len - job.first_tile, batch_max);
+		jobs_run(track_tile_job, &job, batch_len);
+		for (int i = 0; i < batch_len; i++) {
+			render_texture_create(128, 128, job.pixels + i * 128 * 128);
+			g.track.textures.len++;
 		}
-		render_texture_create(temp_tile->width, temp_tile->height, temp_tile->pixels);
-		g.track.textures.len++;
 	}
 
-	mem_temp_free(temp_tile);
-	mem_temp_free(cmp);
-	mem_temp_free(ttf);
+	mem_temp_frame_end(temp_frame); // ttf, cmp and the batch pixels
+	mem_set_tag(mem_tag);
+}
+
+void track_load_geometry(const char *base_path) {
+	mem_tag_t mem_tag = mem_set_tag(MEM_TAG_TRACK);
 
 	vec3_t *vertices = track_load_vertices(get_path(base_path, "track.trv"));
 	track_load_faces(get_path(base_path, "track.trf"), vertices);
@@ -63,6 +100,19 @@ void track_load(const char *base_path) {
 	} while (s != g.track.sections);
 	g.track.total_section_nums = num;
 
+	// Potentially visible sections; a section is drawn if its center is close
+	// enough, so it has to be part of its bounds here.
+	vec3_t *sections_min = mem_temp_alloc(sizeof(vec3_t) * g.track.section_count);
+	vec3_t *sections_max = mem_temp_alloc(sizeof(vec3_t) * g.track.section_count);
+	for (int i = 0; i < g.track.section_count; i++) {
+		section_t *ts = &g.track.sections[i];
+		sections_min[i] = vec3(min(ts->bounds_min.x, ts->center.x), min(ts->bounds_min.y, ts->center.y), min(ts->bounds_min.z, ts->center.z));
+		sections_max[i] = vec3(max(ts->bounds_max.x, ts->center.x), max(ts->bounds_max.y, ts->center.y), max(ts->bounds_max.z, ts->center.z));
+	}
+	pvs_build(&g.track.pvs, sections_min, sections_max, g.track.section_count);
+	mem_temp_free(sections_max);
+	mem_temp_free(sections_min);
+
 	g.track.pickups = mem_mark();
 	for (int i = 0; i < g.track.section_count; i++) {
 		track_face_t *face = track_section_get_base_face(&g.track.sections[i]);
@@ -83,11 +133,13 @@ void track_load(const char *base_path) {
 		
 		error_if(g.track.pickups_len > TRACK_PICKUPS_MAX-1, "Track %s exceeds TRACK_PICKUPS_MAX", base_path);
 	}
+
+	mem_set_tag(mem_tag);
 }
 
 ttf_t *track_load_tile_format(char *ttf_name) {
 	uint32_t ttf_size;
-	uint8_t *ttf_bytes = file_load(ttf_name, &ttf_size);
+	uint8_t *ttf_bytes = file_map(ttf_name, &ttf_size);
 
 	uint32_t p = 0;
 	uint32_t num_tiles = ttf_size / 42;
@@ -104,7 +156,7 @@ ttf_t *track_load_tile_format(char *ttf_name) {
 		}
 		ttf->tiles[t].far = get_i16(ttf_bytes, &p);
 	}
-	mem_temp_free(ttf_bytes);
+	file_unmap(ttf_bytes, ttf_size);
 
 	return ttf;
 }
@@ -123,7 +175,7 @@ bool track_collect_pickups(track_face_t *face) {
 
 vec3_t *track_load_vertices(char *file_name) {
 	uint32_t size;
-	uint8_t *bytes = file_load(file_name, &size);
+	uint8_t *bytes = file_map(file_name, &size);
 
 	g.track.vertex_count = size / 16; // VECTOR_SIZE
 	vec3_t *vertices = mem_temp_alloc(sizeof(vec3_t) * g.track.vertex_count);
@@ -136,7 +188,7 @@ vec3_t *track_load_vertices(char *file_name) {
 		p += 4; // padding
 	}
 
-	mem_temp_free(bytes);
+	file_unmap(bytes, size);
 	return vertices;
 }
 
@@ -147,10 +199,12 @@ static const vec2_t track_uv[2][4] = {
 
 void track_load_faces(char *file_name, vec3_t *vertices) {
 	uint32_t size;
-	uint8_t *bytes = file_load(file_name, &size);
+	uint8_t *bytes = file_map(file_name, &size);
 
 	g.track.face_count = size / 20; // TRACK_FACE_DATA_SIZE
 	g.track.faces = mem_bump(sizeof(track_face_t) * g.track.face_count);
+	g.track.tris = mem_bump(sizeof(tris_t) * g.track.face_count * 2);
+	g.track.tris_textures = mem_bump(sizeof(uint16_t) * g.track.face_count * 2);
 
 	uint32_t p = 0;
 	track_face_t *tf = g.track.faces;
@@ -172,6 +226,11 @@ void track_load_faces(char *file_name, vec3_t *vertices) {
 		rgba_t color = {.as_uint32 = get_i32_le(bytes, &p) | 0xff000000};
 		const vec2_t *uv = track_uv[flags_is(tf->flags, FACE_FLIP_TEXTURE) ? 1 : 0];
 
+		uint16_t tex_index = texture_from_list(g.track.textures, tf->texture);
+		g.track.tris_textures[i * 2 + 0] = tex_index;
+		g.track.tris_textures[i * 2 + 1] = tex_index;
+
+		tf->tris = &g.track.tris[i * 2];
 		tf->tris[0] = (tris_t){
 			.vertices = {
 				{.pos = v0, .uv = uv[0], .color = color},
@@ -190,13 +249,15 @@ void track_load_faces(char *file_name, vec3_t *vertices) {
 		tf++;
 	}
 
-	mem_temp_free(bytes);
+	file_unmap(bytes, size);
+
+	g.track.mesh = render_mesh_create(g.track.tris, g.track.tris_textures, g.track.face_count * 2, g.track.face_count);
 }
 
 
 void track_load_sections(char *file_name) {
 	uint32_t size;
-	uint8_t *bytes = file_load(file_name, &size);
+	uint8_t *bytes = file_map(file_name, &size);
 
 	g.track.section_count = size / 156; // SECTION_DATA_SIZE
 	g.track.sections = mem_bump(sizeof(section_t) * g.track.section_count);
@@ -237,6 +298,17 @@ void track_load_sections(char *file_name) {
 		ts->face_start = get_i16(bytes, &p);
 		ts->face_count = get_i16(bytes, &p);
 
+		ts->bounds_min = vec3(INFINITY, INFINITY, INFINITY);
+		ts->bounds_max = vec3(-INFINITY, -INFINITY, -INFINITY);
+		tris_t *tris = g.track.tris + ts->face_start * 2;
+		for (int j = 0; j < ts->face_count * 2; j++) {
+			for (int v = 0; v < 3; v++) {
+				vec3_t pos = tris[j].vertices[v].pos;
+				ts->bounds_min = vec3(min(ts->bounds_min.x, pos.x), min(ts->bounds_min.y, pos.y), min(ts->bounds_min.z, pos.z));
+				ts->bounds_max = vec3(max(ts->bounds_max.x, pos.x), max(ts->bounds_max.y, pos.y), max(ts->bounds_max.z, pos.z));
+			}
+		}
+
 		p += 2 * 2; // global/local radius
 
 		ts->flags = get_i16(bytes, &p);
@@ -245,23 +317,14 @@ void track_load_sections(char *file_name) {
 		ts++;
 	}
 
-	mem_temp_free(bytes);
+	file_unmap(bytes, size);
 }
 
 
 
 
 void track_draw_section(section_t *section) {
-	track_face_t *face = g.track.faces + section->face_start;
-	int16_t face_count = section->face_count;
-	
-
-	for (uint32_t j = 0; j < face_count; j++) {
-		uint16_t tex_index = texture_from_list(g.track.textures, face->texture);
-		render_push_tris(face->tris[0], tex_index);
-		render_push_tris(face->tris[1], tex_index);
-		face++;
-	}
+	render_mesh_draw(g.track.mesh, section->face_start * 2, section->face_count * 2);
 }
 
 void track_draw(camera_t *camera) {	
@@ -270,16 +333,33 @@ void track_draw(camera_t *camera) {
 	
 	float max_dist_sq = RENDER_FADEOUT_FAR * RENDER_FADEOUT_FAR;
 	vec3_t cam_pos = camera->position;
+	frustum_t frustum = render_frustum();
+	uint32_t *pvs = pvs_for_camera(&g.track.pvs, camera);
 
-	section_t *s = g.track.sections;
-	for(int32_t i = 0; i < g.track.section_count; ++i, ++s)
-	{
+	// The faces of consecutive sections are mostly consecutive as well; merge
+	// them into as few draws as possible.
+	int32_t draw_start = 0;
+	int32_t draw_len = 0;
+
+	for (int32_t i = pvs_next(&g.track.pvs, pvs, 0); i >= 0; i = pvs_next(&g.track.pvs, pvs, i + 1)) {
+		section_t *s = &g.track.sections[i];
 		vec3_t d = vec3_sub(cam_pos, s->center);
 		float dist_sq = d.x * d.x + d.y * d.y + d.z * d.z;
-		if (dist_sq <  max_dist_sq) {
-			track_draw_section(s);
+		if (
+			dist_sq < max_dist_sq &&
+			frustum_aabb_visible(&frustum, s->bounds_min, s->bounds_max)
+		) {
+			if (draw_len > 0 && s->face_start == draw_start + draw_len) {
+				draw_len += s->face_count;
+			}
+			else {
+				render_mesh_draw(g.track.mesh, draw_start * 2, draw_len * 2);
+				draw_start = s->face_start;
+				draw_len = s->face_count;
+			}
 		}
 	}
+	render_mesh_draw(g.track.mesh, draw_start * 2, draw_len * 2);
 
 	render_pop_matrix();
 }
@@ -315,6 +395,8 @@ void track_face_set_color(track_face_t *face, rgba_t color) {
 	face->tris[1].vertices[0].color = color;
 	face->tris[1].vertices[1].color = color;
 	face->tris[1].vertices[2].color = color;
+
+	render_mesh_update(g.track.mesh, (face - g.track.faces) * 2, 2);
 }
 
 track_face_t *track_section_get_base_face(section_t *section) {
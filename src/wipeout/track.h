@@ -5,6 +5,7 @@
 #include "../types.h"
 #include "object.h"
 #include "image.h"
+#include "pvs.h"
 
 #define TRACK_VERSION 8
 
@@ -12,6 +13,7 @@
 #define TRACK_FACES_MAX    3072
 #define TRACK_SECTIONS_MAX 1024
 #define TRACK_PICKUPS_MAX    64
+#define TRACK_TILES_PER_THREAD 2
 
 #define TRACK_PICKUP_COOLDOWN_TIME 1
 
@@ -19,7 +21,7 @@
 #define TRACK_SEARCH_LOOK_AHEAD 6
 
 typedef struct track_face_t {
-	tris_t tris[2];
+	tris_t *tris; // 2 tris in track_t.tris
 	vec3_t normal;
 	uint8_t flags;
 	uint8_t texture;
@@ -51,6 +53,8 @@ typedef struct section_t {
 	struct section_t *next;
 
 	vec3_t center;
+	vec3_t bounds_min; // of all tris in face_start..face_count
+	vec3_t bounds_max;
 
 	int16_t high[4];
 	int16_t med[4];
@@ -80,13 +84,19 @@ typedef struct track_t {
 	int32_t total_section_nums;
 	texture_list_t textures;
 	
+	tris_t *tris;
+	uint16_t *tris_textures;
+	uint16_t mesh;
+
 	track_face_t *faces;
 	section_t *sections;
 	track_pickup_t *pickups;
+	pvs_t pvs; // of sections
 } track_t;
 
 
-void track_load(const char *base_path);
+void track_load_textures(const char *base_path);
+void track_load_geometry(const char *base_path);
 ttf_t *track_load_tile_format(char *ttf_name);
 vec3_t *track_load_vertices(char *file);
 void track_load_faces(char *file, vec3_t *vertices);
@@ -0,0 +1,82 @@
+#include "../render.h"
+#include "../utils.h"
+
+#include "visibility.h"
+
+typedef struct {
+	Object *object;
+	float dist_sq;
+} visibility_entry_t;
+
+static frustum_t frustum;
+static vec3_t camera_pos;
+static visibility_entry_t visible[VISIBILITY_OBJECTS_MAX];
+
+void visibility_begin(camera_t *camera) {
+	frustum = render_frustum();
+	camera_pos = camera->position;
+}
+
+static float visibility_test(Object *object, mat4_t *mat) {
+	vec3_t center = vec3(mat->m[12], mat->m[13], mat->m[14]);
+	if (!frustum_sphere_visible(&frustum, center, object->radius)) {
+		return -1;
+	}
+
+	// The old test only looked at the origin; keep objects whose bounds
+	// reach into the fadeout range.
+	vec3_t d = vec3_sub(camera_pos, center);
+	float dist_sq = vec3_dot(d, d);
+	float max_dist = RENDER_FADEOUT_FAR + object->radius;
+	if (dist_sq >= max_dist * max_dist) {
+		return -1;
+	}
+	return dist_sq;
+}
+
+bool visibility_object_visible(Object *object, mat4_t *mat) {
+	return visibility_test(object, mat) >= 0;
+}
+
+static inline bool visibility_entry_compare(visibility_entry_t *a, visibility_entry_t *b) {
+	return a->dist_sq > b->dist_sq;
+}
+
+void visibility_draw_objects(Object **objects, pvs_t *pvs, uint32_t *set) {
+	uint32_t opaque_len = 0;
+	uint32_t visible_len = 0;
+
+	for (int32_t i = pvs_next(pvs, set, 0); i >= 0; i = pvs_next(pvs, set, i + 1)) {
+		Object *object = objects[i];
+		float dist_sq = visibility_test(object, &object->mat);
+		if (dist_sq < 0) {
+			continue;
+		}
+		if (visible_len >= VISIBILITY_OBJECTS_MAX) {
+			object_draw(object, &object->mat);
+			continue;
+		}
+
+		// Opaque objects are kept at the front, translucent ones at the back,
+		// both in list order
+		if (object->is_translucent) {
+			visible[VISIBILITY_OBJECTS_MAX - 1 - (visible_len - opaque_len)] = (visibility_entry_t){object, dist_sq};
+		}
+		else {
+			visible[opaque_len++] = (visibility_entry_t){object, dist_sq};
+		}
+		visible_len++;
+	}
+
+	#if VISIBILITY_SORT_FRONT_TO_BACK
+		sort(visible, opaque_len, visibility_entry_compare);
+	#endif
+
+	for (uint32_t i = 0; i < opaque_len; i++) {
+		object_draw(visible[i].object, &visible[i].object->mat);
+	}
+	for (uint32_t i = 0; i < visible_len - opaque_len; i++) {
+		Object *object = visible[VISIBILITY_OBJECTS_MAX - 1 - i].object;
+		object_draw(object, &object->mat);
+	}
+}
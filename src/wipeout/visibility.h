@@ -0,0 +1,30 @@
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+#include "../types.h"
+#include "object.h"
+#include "camera.h"
+#include "pvs.h"
+
+// Draw opaque objects front to back, so that the depth test rejects more of
+// the objects behind them. Translucent objects are always drawn afterwards,
+// in their original order.
+#ifndef VISIBILITY_SORT_FRONT_TO_BACK
+	#define VISIBILITY_SORT_FRONT_TO_BACK 1
+#endif
+
+#define VISIBILITY_OBJECTS_MAX 1024
+
+// Remember the frustum and position of the current 3d view. Must be called
+// after render_set_view() and before any of the tests below.
+void visibility_begin(camera_t *camera);
+
+// Test the bounding sphere of an object, placed by mat, against the view
+// frustum and the fadeout distance.
+bool visibility_object_visible(Object *object, mat4_t *mat);
+
+// Draw all visible objects of those in the potentially visible set, each
+// with its own mat. A NULL set contains all objects.
+void visibility_draw_objects(Object **objects, pvs_t *pvs, uint32_t *set);
+
+#endif
@@ -9,6 +9,7 @@
 #include "game.h"
 #include "image.h"
 #include "particle.h"
+#include "visibility.h"
 
 extern int32_t ctrlNeedTargetIcon;
 extern int ctrlnearShip;
@@ -221,10 +222,22 @@ void weapons_draw() {
 		if (weapon->model) {
 			mat4_set_translation(&mat, weapon->position);
 			mat4_set_yaw_pitch_roll(&mat, weapon->angle);
+			if (!visibility_object_visible(weapon->model, &mat)) {
+				continue;
+			}
+
+			// Mines and shields share one model whose colors are set for each
+			// instance, so they are drawn without the model's mesh
 			if (weapon->model == weapon_assets.mine) {
 				weapon_update_mine_lights(weapon, i);
+				object_draw_dynamic(weapon->model, &mat);
+			}
+			else if (weapon->model == weapon_assets.shield || weapon->model == weapon_assets.shield_internal) {
+				object_draw_dynamic(weapon->model, &mat);
+			}
+			else {
+				object_draw(weapon->model, &mat);
 			}
-			object_draw(weapon->model, &mat);
 		}
 	}
 }